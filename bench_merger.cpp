@@ -0,0 +1,171 @@
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdint>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "pair_table.h"
+#include "utils.h"
+#include "bench_merger.h"
+using namespace std;
+using namespace utils;
+
+/* Measures the join phase of combine_R1_R2 on synthetic records: R1 keys
+ * are spread over the partitions like Map_merger::partition does, then every
+ * thread count from 1 to --threads (doubling) builds one Pair_table per
+ * partition and probes it with as many R2 keys, half of them without a mate.
+ * Partitions are taken off a shared counter, so the tables are built and
+ * probed without locks. */
+
+typedef struct bench_state {
+	vector< vector<uint64_t> > keys1;	// R1 keys per partition
+	vector< vector<uint64_t> > keys2;	// R2 keys per partition
+	vector<Pair_table*> tables;
+	string payload;
+	size_t next_part;
+	uint64_t hits;
+	boost::mutex mtx;
+} BENCH_STATE;
+
+/* takes the next partition, returns false when none are left
+ * arguments:
+ * 	benchmark state
+ * 	partition (output)
+ * 	*/
+static bool next_partition(BENCH_STATE& s, size_t& p) {
+	// critical
+	s.mtx.lock();
+	p = s.next_part++;
+	s.mtx.unlock();
+	// end critical
+	return p < s.keys1.size();
+}
+
+/* builds the tables of the partitions
+ * arguments:
+ * 	benchmark state
+ * 	*/
+static void build_tables(BENCH_STATE* s) {
+	size_t p;
+	while (next_partition(*s, p)) {
+		vector<uint64_t>& k = s->keys1.at(p);
+		Pair_table* t = s->tables.at(p);
+		t->clear();
+		t->reserve(k.size(), k.size() * s->payload.length());
+		for (size_t i = 0; i < k.size(); ++i) { t->insert(k.at(i), s->payload); }
+	}
+}
+
+/* probes the tables of the partitions with the R2 keys
+ * arguments:
+ * 	benchmark state
+ * 	*/
+static void probe_tables(BENCH_STATE* s) {
+	size_t p;
+	uint64_t hits = 0;
+	const char* f;
+	uint32_t len;
+	while (next_partition(*s, p)) {
+		vector<uint64_t>& k = s->keys2.at(p);
+		const Pair_table* t = s->tables.at(p);
+		for (size_t i = 0; i < k.size(); ++i) {
+			if (t->find(k.at(i), f, len)) { hits += len; }
+		}
+	}
+	// critical
+	s->mtx.lock();
+	s->hits += hits;
+	s->mtx.unlock();
+	// end critical
+}
+
+/* runs one phase on a number of threads
+ * returns the elapsed seconds
+ * arguments:
+ * 	phase
+ * 	benchmark state
+ * 	number of threads
+ * 	*/
+static double run_phase(void (*phase)(BENCH_STATE*), BENCH_STATE& s, uint32_t nthr) {
+	s.next_part = 0;
+	boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+	boost::thread_group tgroup;
+	for (uint32_t i = 0; i < nthr; ++i) {
+		tgroup.create_thread(boost::bind(phase, &s));
+	}
+	tgroup.join_all();
+	boost::posix_time::time_duration d = boost::posix_time::microsec_clock::universal_time() - start;
+	return d.total_microseconds() / 1e6;
+}
+
+int main(int argc, char** argv) {
+
+	uint64_t n_records = 1000000;
+	uint32_t n_parts = 64;
+	uint32_t max_threads = 32;
+	uint32_t payload_len = 40;
+
+	int opt = 0;
+	while (1) {
+		int long_index = 0;
+		opt = getopt_long(argc, argv, "n::p::t::l::h", long_options, &long_index);
+		if (opt == -1) { break; }
+		switch(opt) {
+			case 'n'	: n_records = atol(optarg);	break;
+			case 'p'	: n_parts = atoi(optarg);	break;
+			case 't'	: max_threads = atoi(optarg);	break;
+			case 'l'	: payload_len = atoi(optarg);	break;
+
+			case 'h'	: cout << bm_usage << endl;	exit(BMEC_NO_ERROR);
+			case '?'	: report_error(	__FILE__,__func__,BM_BAD_COMMAND_LINE);
+					  exit(BMEC_BAD_COMMAND_LINE);
+
+			default		: cout << bm_usage << endl; 	exit(BMEC_BAD_COMMAND_LINE);
+		}
+	}
+
+	if (!n_records || !n_parts || !max_threads) {
+		report_error(__FILE__,__func__, BM_BAD_COMMAND_LINE);
+		exit(BMEC_BAD_COMMAND_LINE);
+	}
+
+	BENCH_STATE s;
+	s.keys1.resize(n_parts);
+	s.keys2.resize(n_parts);
+	s.payload = string(payload_len, 'A');
+	for (uint32_t p = 0; p < n_parts; ++p) { s.tables.push_back(new Pair_table); }
+
+	// keys laid out like packed read IDs (lane, tile, x, y), R2 keys
+	// without a mate get a y coordinate no R1 record has
+	uint64_t x = 88172645463325252ULL;
+	for (uint64_t i = 0; i < n_records; ++i) {
+		x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+		uint64_t key = ((x >> 40) << 21) | (i & 0xFFFFF);
+		size_t p = boost::hash<uint64_t>()(key) % n_parts;
+		s.keys1.at(p).push_back(key);
+		key = (i & 1) ? key : (key | 0x100000);
+		s.keys2.at(boost::hash<uint64_t>()(key) % n_parts).push_back(key);
+	}
+
+	cout << "records:\t" << n_records << endl;
+	cout << "partitions:\t" << n_parts << endl;
+	cout << "payload:\t" << payload_len << endl;
+	// allocate the tables once so every run reuses them
+	run_phase(build_tables, s, 1);
+
+	cout << "threads\tbuild Mrec/s\tprobe Mrec/s" << endl;
+	for (uint32_t nthr = 1; nthr <= max_threads; nthr *= 2) {
+		double tb = run_phase(build_tables, s, nthr);
+		double tp = run_phase(probe_tables, s, nthr);
+		cout << nthr << "\t" << fixed << setprecision(2);
+		cout << n_records / tb / 1e6 << "\t" << n_records / tp / 1e6 << endl;
+	}
+
+	// cleanup
+	for (uint32_t p = 0; p < n_parts; ++p) { delete(s.tables.at(p)); }
+
+	return BMEC_NO_ERROR;
+}
@@ -0,0 +1,37 @@
+#ifndef __BENCH_MERGER_H__
+#define __BENCH_MERGER_H__
+
+#include <string>
+#include <getopt.h>
+#include <stdlib.h>
+
+string cmd = string(getenv("_"));
+static string bm_usage = 
+	"Usage:	" + cmd + "	[-nptlh] [--records] [--parts] [--threads] [--payload]\n"
+	"			[--help]\n\n"
+	"	long		short	type		description\n"
+	"	====		=====	====		===========\n"
+	"Optional:\n"
+	"	--records	-n	<integer>	number of R1 records (1,000,000)\n"
+	"	--parts		-p	<integer>	number of partitions (64)\n"
+	"	--threads	-t	<integer>	largest number of threads (32)\n"
+	"	--payload	-l	<integer>	bytes of fields per record (40)\n\n"
+	"	--help		-h	<flag>		print this message and exit\n";
+
+static struct option long_options[] = {
+	{"records",	optional_argument, 	NULL,	'n'},
+	{"parts",	optional_argument, 	NULL,	'p'},
+	{"threads",	optional_argument,	NULL,	't'},
+	{"payload",	optional_argument,	NULL,	'l'},
+	{"help",	no_argument,		NULL,	'h'},
+	{0,		0,			0, 	0 }
+};
+
+enum BM_ERRORS {
+	BMEC_NO_ERROR		=	0,
+	BMEC_BAD_COMMAND_LINE	=	11
+};
+
+static string BM_BAD_COMMAND_LINE = 	"bad or missing parameter";
+
+#endif //__BENCH_MERGER_H__
@@ -0,0 +1,84 @@
+#include <vector>
+#include <cmath>
+#include "bloom_filter.h"
+using namespace std;
+
+/* sizes the filter for a number of keys
+ * arguments:
+ * 	expected number of keys
+ * 	bits per key
+ * 	*/
+Bloom_filter::Bloom_filter(uint64_t n, uint32_t bits_per_key) {
+	n_keys = n ? n : 1;
+	n_blocks = (n_keys * bits_per_key + 511) / 512;
+	if (n_blocks == 0) { n_blocks = 1; }
+	bits.assign(n_blocks * BF_BLOCK_WORDS, 0);
+
+	// bits set per key, optimal for a plain filter at bits per key x ln 2
+	k = (uint32_t) (bits_per_key * 0.69 + 0.5);
+	if (k < 1) { k = 1; }
+	if (k > BF_MAX_K) { k = BF_MAX_K; }
+}
+
+Bloom_filter::~Bloom_filter() {}
+
+/* block of a key and the hash its bits within the block are drawn from
+ * arguments:
+ * 	key
+ * 	block (output)
+ * 	hash (output)
+ * 	*/
+void Bloom_filter::positions(uint64_t key, uint64_t& block, uint64_t& h) const {
+	key ^= key >> 30;
+	key *= 0xbf58476d1ce4e5b9ULL;
+	key ^= key >> 27;
+	key *= 0x94d049bb133111ebULL;
+	key ^= key >> 31;
+	block = (uint64_t) (((unsigned __int128) key * n_blocks) >> 64) * BF_BLOCK_WORDS;
+	h = key * 0x9e3779b97f4a7c15ULL;
+}
+
+/* adds a key, safe to call from several threads
+ * arguments:
+ * 	key
+ * 	*/
+void Bloom_filter::insert(uint64_t key) {
+	uint64_t block, h;
+	positions(key, block, h);
+	// 9 bits address a bit of the block, consecutive positions step by an
+	// odd increment so they do not repeat within a block
+	uint32_t a = h & 511;
+	uint32_t b = ((h >> 9) & 511) | 1;
+	for (uint32_t i = 0; i < k; ++i) {
+		uint32_t p = (a + i*b) & 511;
+		uint64_t mask = static_cast<uint64_t>(1) << (p & 63);
+		uint64_t* w = &bits[block + (p >> 6)];
+		if ((*w & mask) != mask) { __sync_fetch_and_or(w, mask); }
+	}
+}
+
+/* tests a key
+ * returns false if the key was certainly not inserted
+ * arguments:
+ * 	key
+ * 	*/
+bool Bloom_filter::contains(uint64_t key) const {
+	uint64_t block, h;
+	positions(key, block, h);
+	uint32_t a = h & 511;
+	uint32_t b = ((h >> 9) & 511) | 1;
+	for (uint32_t i = 0; i < k; ++i) {
+		uint32_t p = (a + i*b) & 511;
+		if (!(bits[block + (p >> 6)] & (static_cast<uint64_t>(1) << (p & 63)))) { return false; }
+	}
+	return true;
+}
+
+size_t Bloom_filter::get_bytes() const { return bits.size() * sizeof(uint64_t); }
+
+/* false positive rate expected with the number of keys the filter was sized
+ * for, a plain filter estimate so blocking adds a little to it */
+double Bloom_filter::get_fp_rate() const {
+	double m = (double) n_blocks * 512;
+	return pow(1 - exp(-(double) k * n_keys / m), k);
+}
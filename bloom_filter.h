@@ -0,0 +1,39 @@
+#ifndef __BLOOM_FILTER_H__
+#define __BLOOM_FILTER_H__
+
+#include <vector>
+#include <cstdint>
+using namespace std;
+
+// 64 bit words per block, a block is one 512 bit cache line
+static const uint32_t BF_BLOCK_WORDS = 8;
+
+// largest number of bits set per key
+static const uint32_t BF_MAX_K = 16;
+
+/* Blocked Bloom filter of 64 bit read keys. All bits of a key fall into one
+ * 512 bit block picked by the key hash, so inserting or testing a key
+ * touches a single cache line. A key that was inserted is always found, a
+ * key that was not is found with about get_fp_rate() probability. Inserts
+ * set bits with atomic ORs and can run concurrently; tests must not overlap
+ * with inserts. */
+class Bloom_filter {
+	public:
+		Bloom_filter(uint64_t n_keys, uint32_t bits_per_key);
+		virtual ~Bloom_filter();
+
+		void insert(uint64_t key);
+		bool contains(uint64_t key) const;
+
+		size_t get_bytes() const;
+		double get_fp_rate() const;
+
+	private:
+		vector<uint64_t> bits;
+		uint64_t n_blocks;
+		uint64_t n_keys;
+		uint32_t k;
+
+		void positions(uint64_t key, uint64_t& block, uint64_t& h) const;
+};
+#endif //__BLOOM_FILTER_H__
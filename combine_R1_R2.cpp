@@ -1,4 +1,5 @@
 #include "map_merger.h"
+#include "lane_scheduler.h"
 #include "utils.h"
 #include "combine_R1_R2.h"
 #include <getopt.h>
@@ -15,9 +16,16 @@ int main(int argc, char** argv) {
 	char* in1 =		NULL;
 	char* in2 =		NULL;
 	char* out = 		NULL;
-
-	uint32_t lines =	100000000;
+	char* out1 = 		NULL;
+	char* out2 = 		NULL;
+	char* lanes = 		NULL;
+	uint8_t concurrent =	0;
+
+	uint16_t parts =	0;
+	uint64_t memory =	0;
+	char* tmp =		NULL;
 	uint32_t load = 	10000;
+	uint32_t window =	0;
 	uint8_t threads =	15;
 
 	bool quiet = 		false;
@@ -31,16 +39,24 @@ int main(int argc, char** argv) {
 	int opt = 0;
 	while (1) {
 		int long_index = 0;
-		opt = getopt_long(argc, argv, "1:2:o::l::t::f::I::O::qh", long_options, &long_index);
+		opt = getopt_long(argc, argv, "1:2:o::3::4::L::c::l::p::m::T::t::f::w::I::O::qh", long_options, &long_index);
 		if (opt == -1) { break; }
 		switch(opt) {
 			case '1' 	: in1 = optarg; 		break;
 			case '2' 	: in2 = optarg; 		break;
 			case 'o' 	: out = optarg; 		break;
-
-			case 'l'	: lines = atoi(optarg); 	break;
+			case '3' 	: out1 = optarg; 		break;
+			case '4' 	: out2 = optarg; 		break;
+			case 'L' 	: lanes = optarg; 		break;
+			case 'c' 	: concurrent = atoi(optarg);	break;
+
+			case 'l'	: 				break;	// no longer used
+			case 'p'	: parts = atoi(optarg);		break;
+			case 'm'	: memory = atol(optarg);	break;
+			case 'T'	: tmp = optarg;			break;
 			case 't'	: threads = atoi(optarg);	break;
 			case 'f'	: load = atoi(optarg);		break;
+			case 'w'	: window = atoi(optarg);	break;
 
 			case 'I'	: in_sep = string(optarg);	break;
 			case 'O'	: out_sep = string(optarg);	break;
@@ -55,12 +71,37 @@ int main(int argc, char** argv) {
 		}
 	}
 
+	// the lanes file names the inputs and outputs of every lane
+	if (lanes) {
+		if (in1 || in2 || out || out1 || out2) {
+			report_error(__FILE__,__func__,CR_LANES_INPUTS);
+			exit(CREC_BAD_COMMAND_LINE);
+		}
+
+		Lane_scheduler ls(threads, concurrent, memory * 1048576);
+		ls.load(lanes);
+		if (tmp) { ls.set_tmp_dir(string(tmp)); }
+		ls.set_n_parts(parts);
+		ls.set_window(window);
+		ls.set_load_factor(load);
+		ls.set_input_sep(in_sep);
+		ls.set_output_sep(out_sep);
+		ls.run(quiet);
+		return CREC_NO_ERROR;
+	}
+
 	// must speify input filenames
 	if ( !in1 || !in2 ) {
 		report_error(__FILE__,__func__,CR_BAD_FILENAME + "--in1,-1 or --in2,-2");
 		exit(CREC_BAD_FILENAME);
 	}
 
+	// unpaired records are only known to the partitioned join
+	if (window && (out1 || out2)) {
+		report_error(__FILE__,__func__,CR_UNPAIRED_WINDOW);
+		exit(CREC_BAD_COMMAND_LINE);
+	}
+
 	// set zipped input flag
 	if (	(string(in1).find(".gz") != string::npos) ||
 		(string(in2).find(".gz") != string::npos)) {
@@ -72,9 +113,20 @@ int main(int argc, char** argv) {
 		out_z = true;
 	}
 
-	Map_merger mm(in1, in2, out, lines);
+	Map_merger mm(in1, in2, out);
+	if (tmp) { mm.set_tmp_dir(string(tmp)); }
 	mm.set_n_threads(threads);
 	mm.set_load_factor(load);
+	mm.set_window(window);
+	mm.set_unpaired_outputs(out1, out2);
+
+	// the partitions are planned from the inputs and the memory unless set
+	if (parts) {
+		mm.set_n_parts(parts);
+	} else if (!window) {
+		mm.set_memory(memory * 1048576);
+		mm.plan_join(in_z);
+	}
 	mm.set_input_sep(in_sep);
 	mm.set_output_sep(out_sep);
 
@@ -82,6 +134,10 @@ int main(int argc, char** argv) {
 	if (!quiet) { mm.print_params(); }
 
 	mm.merge_id_maps(in_z, out_z);
+	if (!quiet && out) {
+		cout << "process peak RSS:\t" << peak_rss() / 1048576 << " MB" << endl;
+		mm.print_stats();
+	}
 
 	return CREC_NO_ERROR;
 }
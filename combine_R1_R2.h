@@ -7,20 +7,31 @@
 
 string cmd = string(getenv("_"));
 static string cr_usage = 
-	"Usage:	" + cmd + "	[-12oIOltfqh] [--in1] [--in2] [--out] [--in_sep] [--out_sep]\n"
-	"			[--lines] [--threads] [--load] [--quiet] [--help]\n\n"
+	"Usage:	" + cmd + "	[-12o34LcIOpmTtfwqh] [--in1] [--in2] [--out] [--out1] [--out2]\n"
+	"			[--lanes] [--concurrent]\n"
+	"			[--in_sep] [--out_sep] [--parts] [--memory] [--tmp]\n"
+	"			[--threads] [--load] [--window] [--quiet] [--help]\n\n"
 	"	long		short	type		description\n"
 	"	====		=====	====		===========\n"
 	"Required:\n"
 	"	--in1		-1	<filename>	read1 sequences\n"
 	"	--in2		-2	<filename>	read2 sequences\n\n"
 	"Optional:\n"
-	"	--out		-o	<filename>	output file (stdout)\n\n"
+	"	--out		-o	<filename>	output file (stdout)\n"
+	"	--out1		-3	<filename>	unpaired read1 records (off)\n"
+	"	--out2		-4	<filename>	unpaired read2 records (off)\n\n"
+	"	--lanes		-L	<filename>	pair every lane of this file instead of --in1/--in2,\n"
+	"					one per line: R1 R2 out [out1 out2] (off)\n"
+	"	--concurrent	-c	<integer>	lanes paired at a time (threads / 4)\n\n"
 	"	--in_sep	-I	<string|char>	input file delimiter (tab)\n"
 	"	--out_sep	-O	<string|char>	output file delimiter (tab)\n\n"
-	"	--lines		-l	<integer>	maximum number of lines (100,000,000)\n"
+	"	--parts		-p	<integer>	number of on-disk partitions (planned)\n"
+	"	--memory	-m	<integer>	memory to plan the join for in MB (available)\n"
+	"	--tmp		-T	<dirname>	directory for the partitions ($TMPDIR or /tmp)\n"
 	"	--threads	-t	<integer>	set number of threads (15)\n"
 	"	--load		-f	<integer>	load factor (10,000)\n\n"
+	"	--window	-w	<integer>	merge inputs in read order with this lookahead\n"
+	"					instead of hashing R1 (off)\n\n"
 	"	--quiet		-q	<flag>		suppress parameters output\n"
 	"	--help		-h	<flag>		print this message and exit\n";
 	
@@ -29,10 +40,18 @@ static struct option long_options[] = {
 	{"in1",		required_argument, 	NULL,	'1'},
 	{"in2",		required_argument, 	NULL,	'2'},
 	{"out",		optional_argument, 	NULL,	'o'},
+	{"out1",	optional_argument, 	NULL,	'3'},
+	{"out2",	optional_argument, 	NULL,	'4'},
+	{"lanes",	optional_argument, 	NULL,	'L'},
+	{"concurrent",	optional_argument, 	NULL,	'c'},
 
 	{"lines",	optional_argument, 	NULL,	'l'},
+	{"parts",	optional_argument, 	NULL,	'p'},
+	{"memory",	optional_argument, 	NULL,	'm'},
+	{"tmp",		optional_argument, 	NULL,	'T'},
 	{"threads",	optional_argument,	NULL,	't'},
 	{"load",	optional_argument,	NULL,	'f'},
+	{"window",	optional_argument,	NULL,	'w'},
 
 	{"in_sep",	optional_argument,	NULL,	'I'},
 	{"out_sep",	optional_argument,	NULL,	'O'},
@@ -50,5 +69,7 @@ enum CR_ERRORS {
 
 static string CR_BAD_COMMAND_LINE = 	"bad or missing parameter";
 static string CR_BAD_FILENAME = 	"bad filename for ";
+static string CR_UNPAIRED_WINDOW = 	"--out1,-3 and --out2,-4 need the partitioned join, drop --window,-w";
+static string CR_LANES_INPUTS = 	"--lanes,-L replaces --in1,-1 --in2,-2 --out,-o --out1,-3 and --out2,-4";
 
 #endif //__COMBINE_R1_R2_H__
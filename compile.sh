@@ -8,17 +8,21 @@ echo g++ -O2 get_seq_stats.cpp utils.cpp gzstream.cpp fastq_seq.cpp seq_stats.cp
 g++ -O2 get_seq_stats.cpp utils.cpp gzstream.cpp fastq_seq.cpp seq_stats.cpp gzboost.cpp matrix.h -o get_seq_stats -lboost_thread -lboost_system -lz -lboost_iostreams -std=gnu++0x
 
 echo Compiling: extract_reads
-echo g++ -O2 extract_reads.cpp utils.cpp gzstream.cpp fastq_seq.cpp read_extractor.cpp gzboost.cpp -o extract_reads -lboost_thread -lboost_system -lpcrecpp -lz -lboost_iostreams -std=gnu++0x
-g++ -O2 extract_reads.cpp utils.cpp gzstream.cpp fastq_seq.cpp read_extractor.cpp gzboost.cpp -o extract_reads -lboost_thread -lboost_system -lpcrecpp -lz -lboost_iostreams -std=gnu++0x
+echo g++ -O2 extract_reads.cpp utils.cpp gzstream.cpp fastq_seq.cpp read_extractor.cpp seed_filter.cpp seq_lookup.cpp gzboost.cpp -o extract_reads -lboost_thread -lboost_system -lpcrecpp -lz -lboost_iostreams -std=gnu++0x
+g++ -O2 extract_reads.cpp utils.cpp gzstream.cpp fastq_seq.cpp read_extractor.cpp seed_filter.cpp seq_lookup.cpp gzboost.cpp -o extract_reads -lboost_thread -lboost_system -lpcrecpp -lz -lboost_iostreams -std=gnu++0x
 
 echo Compiling: combine_R1_R2
-echo g++ -O2 combine_R1_R2.cpp utils.cpp fastq_seq.cpp map_merger.cpp gzstream.cpp gzboost.cpp -o combine_R1_R2 -lboost_thread -lboost_system -lz -lboost_iostreams -std=gnu++0x
-g++ -O2 combine_R1_R2.cpp utils.cpp fastq_seq.cpp map_merger.cpp gzstream.cpp gzboost.cpp -o combine_R1_R2 -lboost_thread -lboost_system -lz -lboost_iostreams -std=gnu++0x
+echo g++ -O2 combine_R1_R2.cpp utils.cpp fastq_seq.cpp map_merger.cpp lane_scheduler.cpp pair_table.cpp bloom_filter.cpp gzstream.cpp gzboost.cpp -o combine_R1_R2 -lboost_thread -lboost_system -lz -lboost_iostreams -std=gnu++0x
+g++ -O2 combine_R1_R2.cpp utils.cpp fastq_seq.cpp map_merger.cpp lane_scheduler.cpp pair_table.cpp bloom_filter.cpp gzstream.cpp gzboost.cpp -o combine_R1_R2 -lboost_thread -lboost_system -lz -lboost_iostreams -std=gnu++0x
 
 echo Compiling: get_unpaired
-echo g++ -O2 get_unpaired.cpp utils.cpp fastq_seq.cpp map_merger.cpp gzstream.cpp gzboost.cpp -o get_unpaired -lboost_thread -lboost_system -lz -lboost_iostreams -std=gnu++0x
-g++ -O2 get_unpaired.cpp utils.cpp fastq_seq.cpp map_merger.cpp gzstream.cpp gzboost.cpp -o get_unpaired -lboost_thread -lboost_system -lz -lboost_iostreams -std=gnu++0x
+echo g++ -O2 get_unpaired.cpp utils.cpp fastq_seq.cpp map_merger.cpp pair_table.cpp bloom_filter.cpp gzstream.cpp gzboost.cpp -o get_unpaired -lboost_thread -lboost_system -lz -lboost_iostreams -std=gnu++0x
+g++ -O2 get_unpaired.cpp utils.cpp fastq_seq.cpp map_merger.cpp pair_table.cpp bloom_filter.cpp gzstream.cpp gzboost.cpp -o get_unpaired -lboost_thread -lboost_system -lz -lboost_iostreams -std=gnu++0x
 
 echo Compiling: count_combos
-echo g++ -O2 count_combos.cpp utils.cpp read_counter.cpp gzstream.cpp -o count_combos -lboost_thread -lboost_system -lz -std=gnu++0x
-g++ -O2 count_combos.cpp utils.cpp read_counter.cpp gzstream.cpp -o count_combos -lboost_thread -lboost_system -lz -std=gnu++0x
+echo g++ -O2 count_combos.cpp utils.cpp read_counter.cpp seq_lookup.cpp seq_cache.cpp key_table.cpp gzstream.cpp -o count_combos -lboost_thread -lboost_system -lz -std=gnu++0x
+g++ -O2 count_combos.cpp utils.cpp read_counter.cpp seq_lookup.cpp seq_cache.cpp key_table.cpp gzstream.cpp -o count_combos -lboost_thread -lboost_system -lz -std=gnu++0x
+
+echo Compiling: bench_merger
+echo g++ -O2 bench_merger.cpp utils.cpp pair_table.cpp gzstream.cpp -o bench_merger -lboost_thread -lboost_system -lz -std=gnu++0x
+g++ -O2 bench_merger.cpp utils.cpp pair_table.cpp gzstream.cpp -o bench_merger -lboost_thread -lboost_system -lz -std=gnu++0x
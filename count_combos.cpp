@@ -31,6 +31,10 @@ int main(int argc, char** argv) {
 
 	uint8_t min_qual = 	20;
 	uint8_t lq_bases = 	5;
+	uint8_t extra = 	0;
+	bool umis =		false;
+	bool collapsed =	false;
+	bool edits =		false;
 
 	uint8_t n_threads =	15;
 
@@ -67,7 +71,7 @@ int main(int argc, char** argv) {
 		int long_index = 0;
 		opt = getopt_long(argc,
 				argv, 
-				"xRTFCUYvhi::o::s:m:r::a::b::q::l::t::u::w::P::I::M::O::Q::X::Z::g::c::", 
+				"xdKERTFCUYvhi::o::s:m:r::a::b::q::l::e::t::u::w::P::I::M::O::Q::X::Z::g::c::", 
 				cc_long_options, 
 				&long_index);
 
@@ -86,10 +90,14 @@ int main(int argc, char** argv) {
 			case 'x'	: idxrc = true;					 	break;
 
 			case 'a'	: mms.push_back(atoi(optarg));				break;
+			case 'E'	: edits = true;						break;
 			case 'b'	: idxmm = atoi(optarg); 				break;
 
 			case 'q'	: min_qual = atoi(optarg); 				break;
 			case 'l'	: lq_bases = atoi(optarg); 				break;
+			case 'e'	: extra = atoi(optarg); 				break;
+			case 'd'	: umis = true;		 				break;
+			case 'K'	: collapsed = true;	 				break;
 
 			case 't'	: n_threads = atoi(optarg); 				break;
 			case 'u'	: col_bs = atoi(optarg); 				break;
@@ -185,6 +193,10 @@ int main(int argc, char** argv) {
 	
 	rc.set_min_qual(min_qual);
 	rc.set_max_lq_bases(lq_bases);
+	rc.set_extra_cols(extra);
+	rc.set_with_umis(umis);
+	rc.set_collapsed_input(collapsed);
+	rc.set_edit_reads(edits);
 
 	rc.set_n_threads(n_threads);
 	rc.set_collapser_bite_size(col_bs);
@@ -215,6 +227,7 @@ int main(int argc, char** argv) {
 	if (!quiet) { rc.print_params(); }
 
 	rc.count(in_z);
+	if (!quiet) { rc.print_stats(); }
 	
 	if (out_mode == RAW) { rc.write_raw_counts(); }
 	if (out_mode == TABLE) { rc.write_table(); }
@@ -7,10 +7,11 @@
 
 string cmd = string(getenv("_"));
 static string cc_usage = 
-		"Usage:	" + cmd + "	[-iosmgrxabqltuwYFCUZQXPMIOcRTvh] [--in] [--out] [--smap] [--map]\n"
-		"			[--global] [--rcr] [--rci] [--rmm] [--imm] [--min_q] [--lq_base]\n"
-		"			[--threads] [--col_bs] [--cnt_bs] [--no_undef] [--no_fail] [--no_c_fail]\n"
-		"			[--no_unk] [--undef_t] [--fail_t] [--unk_t] [--p_sep] [--map_sep]\n"
+		"Usage:	" + cmd + "	[-iosmgrxaEbqledKtuwYFCUZQXPMIOcRTvh] [--in] [--out] [--smap] [--map]\n"
+		"			[--global] [--rcr] [--rci] [--rmm] [--edit] [--imm] [--min_q] [--lq_base]\n"
+		"			[--extra] [--umi] [--collapsed] [--threads] [--col_bs] [--cnt_bs] [--no_undef]\n"
+		"			[--no_fail] [--no_c_fail] [--no_unk] [--undef_t] [--fail_t] [--unk_t]\n"
+		"			[--p_sep] [--map_sep]\n"
 		"			[--in_sep] [--out_sep] [--stats] [--raw] [--table] [--quiet] [--help]\n\n"
 		"	Long		short	type		description\n"
 		"	====		=====	====		===========\n"
@@ -24,9 +25,14 @@ static string cc_usage =
 		"	--rcr		-r	<integer>	reverse complement read #\n"
 		"	--rci		-x	<flag>		reverse complement index\n\n"
 		"	--rmm		-a	<integer>	allowed mismatches for reads (1)\n"
+		"	--edit		-E	<flag>		count insertions and deletions in --rmm (false)\n"
 		"	--imm		-b	<integer>	allowed mismatches for index (1)\n\n"
 		"	--min_q		-q	<integer>	minimum per base quality (20)\n"
-		"	--lq_base	-l	<integer>	maximum low quality bases allowed (5)\n\n"
+		"	--lq_base	-l	<integer>	maximum low quality bases allowed (5)\n"
+		"	--extra		-e	<integer>	extra columns per read e.g. strand (0)\n"
+		"	--umi		-d	<flag>		the first extra column is a UMI, count\n"
+		"					unique molecules too (false)\n"
+		"	--collapsed	-K	<flag>		input written by extract_reads --collapse\n\n"
 		"	--threads	-t	<integer>	number of threads to run (15)\n"
 		"	--col_bs	-u	<integer>	collapeser bite size (250000)\n"
 		"	--cnt_bs	-w	<integer>	counter bites size (1000)\n\n"
@@ -59,10 +65,14 @@ static struct option cc_long_options[] = {
 		{"rci",		no_argument, 		NULL,	'x'},
 
 		{"rmm",		optional_argument, 	NULL,	'a'},
+		{"edit",	no_argument, 		NULL,	'E'},
 		{"imm",		optional_argument, 	NULL,	'b'},
 
 		{"min_q",	optional_argument, 	NULL,	'q'},
 		{"lq_base",	optional_argument, 	NULL,	'l'},
+		{"extra",	optional_argument, 	NULL,	'e'},
+		{"umi",		no_argument, 		NULL,	'd'},
+		{"collapsed",	no_argument, 		NULL,	'K'},
 		
 		{"n_thr",	optional_argument, 	NULL,	't'},
 		{"col_bs",	optional_argument, 	NULL,	'u'},
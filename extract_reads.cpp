@@ -16,6 +16,8 @@ int main(int argc, char** argv) {
 	char* in_file = NULL;
 	char* out_file = NULL;
 	char* rej_file = NULL;
+	char* design_file = NULL;
+	char* smap = NULL;
 
 	string pat_l;
 	string pat_r;
@@ -24,6 +26,7 @@ int main(int argc, char** argv) {
 	vector<uint16_t> roi_max;
 
 	vector<string> spacers;
+	vector<string> umis;
 
 	bool z_in =	false;
 	bool z_out =	false;
@@ -41,6 +44,18 @@ int main(int argc, char** argv) {
 	bool mmr = 	true;
 	bool mms = 	true;
 	bool fq_out = 	false;
+	bool collapse =	false;
+	uint8_t min_q =	20;
+	uint8_t lq_bases = 5;
+	string fail_tag = "Q_FAIL";
+	bool both =	false;
+	bool idxrc =	false;
+	bool split_rej = false;
+	uint8_t idxmm =	1;
+
+	uint8_t edl =	0;
+	uint8_t edr =	0;
+	vector<uint8_t> eds;
 
 	string out_sep = "\t";
 
@@ -48,7 +63,7 @@ int main(int argc, char** argv) {
 
 	while (1) {
 		int long_index = 0;
-		opt = getopt_long(argc, argv, "LRSFi::x::v::l:r:m:M:t::f::O::s::qh", long_options, &long_index);
+		opt = getopt_long(argc, argv, "LRSFCBXJi::x::v::l:r:m:M:t::f::O::s::u:a::b::c::D:P:I::Q:E:T:qh", long_options, &long_index);
 		if (opt == -1) {
 			break;
 		}
@@ -62,6 +77,12 @@ int main(int argc, char** argv) {
 			case 'r'	: pat_r = string(optarg); 		break;
 
 			case 's'	: spacers.push_back(string(optarg));	break;
+			case 'u'	: umis.push_back(string(optarg));	break;
+			case 'D'	: design_file = optarg;			break;
+			case 'P'	: smap = optarg;			break;
+			case 'I'	: idxmm = atoi(optarg);			break;
+			case 'X'	: idxrc = true;				break;
+			case 'J'	: split_rej = true;			break;
 
 			case 'O'	: out_sep = string(optarg); 		break;
 
@@ -74,7 +95,16 @@ int main(int argc, char** argv) {
 			case 'L'	: mml = false;				break;
 			case 'R'	: mmr = false;				break;
 			case 'S'	: mms = false;				break;
+
+			case 'a'	: edl = atoi(optarg);			break;
+			case 'b'	: edr = atoi(optarg);			break;
+			case 'c'	: eds.push_back(atoi(optarg));		break;
 			case 'F'	: fq_out = true;			break;
+			case 'C'	: collapse = true;			break;
+			case 'Q'	: min_q = atoi(optarg);			break;
+			case 'E'	: lq_bases = atoi(optarg);		break;
+			case 'T'	: fail_tag = string(optarg);		break;
+			case 'B'	: both = true;				break;
 
 			case 'q'	: quiet = true;				break;
 
@@ -92,17 +122,19 @@ int main(int argc, char** argv) {
 		}
 	}
 
-	if (roi_min.empty()) {
+	if (design_file) {
+		// layouts come from the design file
+	} else if (roi_min.empty()) {
 		report_error(__FILE__, __func__, ER_MISSING_ARGUMENT + string("--roi_min,-m"));
 		exit(EREC_BAD_COMMAND_LINE);
 	}
 
-	if (roi_max.empty()) {
+	if (!design_file && roi_max.empty()) {
 		report_error(__FILE__, __func__, ER_MISSING_ARGUMENT + string("--roi_max,-M"));
 		exit(EREC_BAD_COMMAND_LINE);
 	}
 
-	if (roi_min.size() != roi_max.size()) {
+	if (!design_file && (roi_min.size() != roi_max.size())) {
 		report_error(__FILE__, __func__, ER_BAD_ROI_PARAMS);
 		exit(EREC_BAD_ROI_PARAMS);
 	}
@@ -112,6 +144,11 @@ int main(int argc, char** argv) {
 		exit(EREC_BAD_SPACER_COUNT);
 	}
 
+	if (eds.size() > spacers.size()) {
+		report_error(__FILE__, __func__, ER_BAD_SPACER);
+		exit(EREC_BAD_SPACER_COUNT);
+	}
+
 	if (in_file && (string(in_file).find(".gz") != string::npos)) { z_in = true; }
 	if (rej_file && (string(rej_file).find(".gz") != string::npos)) { z_rej = true; }
 	if (out_file && (string(out_file).find(".gz") != string::npos)) { z_out = true; }
@@ -133,14 +170,28 @@ int main(int argc, char** argv) {
 	rx.set_mm_r(mmr);
 	rx.set_mm_s(mms);
 
+	rx.set_ed_l(edl);
+	rx.set_ed_r(edr);
+	rx.set_ed_s(eds);
+
 	rx.set_with_valid(w_valid);
 	rx.set_with_rejected(w_rej);
+	rx.set_split_rejected(split_rej);
 	rx.set_fastq_out(fq_out);
+	rx.set_collapsed(collapse);
+	rx.set_min_qual(min_q);
+	rx.set_max_lq_bases(lq_bases);
+	rx.set_fail_tag(fail_tag);
+	rx.set_both_strands(both);
 
 	rx.set_output_sep(out_sep);
+	rx.set_umis(umis);
+	if (design_file) { rx.load_designs(design_file); }
+	if (smap) { rx.load_samples(smap, idxmm, idxrc); }
 	if (!quiet) { rx.print_params(); }
 
 	rx.extract(z_in, z_out, z_rej);
+	if (!quiet) { rx.print_stats(); }
 
 	return 0;
 }
@@ -7,12 +7,14 @@
 
 string cmd = string(getenv("_"));
 static string er_usage = 
-	"Usage: " + cmd +"	[-ilrmMsvFxOtfLRSqh] [--in] [--left] [--right] [--roi_min]\n"
-	"			[--roi_max] [--spacer] [--valid] [--fastq_out] [--rejected] [--out_sep]\n"
-	"			[--threads] [--load] [--no_mml] [--no_mmr] [--no_mms] [--quiet] [--help]\n\n"
+	"Usage: " + cmd +"	[-ilrmMsuDPIXvFCQETxJOtfLRSabcBqh] [--in] [--left] [--right] [--roi_min]\n"
+	"			[--roi_max] [--spacer] [--umi] [--designs] [--smap] [--imm] [--rci] [--valid]\n"
+	"			[--fastq_out] [--collapse] [--min_q] [--lq_base] [--fail_t] [--rejected]\n"
+	"			[--by_reason] [--out_sep] [--threads] [--load] [--no_mml] [--no_mmr]\n"
+	"			[--no_mms] [--ed_l] [--ed_r] [--ed_s] [--both] [--quiet] [--help]\n\n"
 	"	long		short	type		description\n"
 	"	====		=====	====		===========\n"
-	"Required:\n"
+	"Required (unless --designs is given):\n"
 	"	--left		-l	<string>	left anchor sequence\n"
 	"	--right		-r	<string>	right anchor sequence\n"
 	"	--roi_min	-m	<integer>	minimum length of ROI\n"
@@ -20,15 +22,31 @@ static string er_usage =
 	"Optional:\n"
 	"	--in		-i	<filename>	input FASTQ file (stdin)\n"
 	"	--spacer	-s	<string|char>	spacer sequence\n"
+	"	--umi		-u	<string>	UMI next to an element, <l|r|s<n>><+|-><length>\n"
+	"					e.g. l+8 follows the left anchor (repeatable)\n"
+	"	--designs	-D	<filename>	several designs matched in one pass\n"
+	"	--smap		-P	<filename>	sample map, valid reads are split by sample\n"
+	"	--imm		-I	<integer>	allowed mismatches for index (1)\n"
+	"	--rci		-X	<flag>		reverse complement index\n"
 	"	--valid		-v	<filename>	accepted reads output (stdout)\n"
 	"	--fastq_out	-F	<flag>		write accepted reads in FASTQ format (false)\n"
-	"	--rejected	-x	<filename>	rejected reads output (stdout)\n\n"
+	"	--collapse	-C	<flag>		write unique index/ROI tuples with read counts\n"
+	"	--min_q		-Q	<integer>	minimum per base quality for --collapse (20)\n"
+	"	--lq_base	-E	<integer>	maximum low quality bases for --collapse (5)\n"
+	"	--fail_t	-T	<string|char>	quality fail tag for --collapse (Q_FAIL)\n"
+	"	--rejected	-x	<filename>	rejected reads output (stdout)\n"
+	"	--by_reason	-J	<flag>		one rejected output per rejection reason\n\n"
 	"	--out_sep	-O	<string|char>	output file delimiter (tab)\n\n"
 	"	--threads	-t	<integer>	number of threads (15)\n"
 	"	--load		-f	<integer>	load factor (10,000)\n\n"
 	"	--no_mml	-L	<flag>		disallow mismatches in left anchor sequence\n"
 	"	--no_mmr	-R	<flag>		disallow mismatches in right anchor sequence\n"
 	"	--no_mms	-S	<flag>		disallow mismatches in spacer sequences\n\n"
+	"	--ed_l		-a	<integer>	allowed edits (indels) in left anchor (0)\n"
+	"	--ed_r		-b	<integer>	allowed edits (indels) in right anchor (0)\n"
+	"	--ed_s		-c	<integer>	allowed edits (indels) in spacer, per spacer (0)\n\n"
+	"	--both		-B	<flag>		search the reverse strand too, ROIs are written\n"
+	"					in forward orientation with a +/- strand flag (false)\n\n"
 	"	--quiet		-q	<flag>		suppress parameters output\n"
 	"	--help		-h	<flag>		print this message and exit\n";
 
@@ -38,11 +56,22 @@ static struct option long_options[] = {
 	{"rejected",	optional_argument, 	NULL,	'x'},
 	{"valid",	optional_argument, 	NULL,	'v'},
 	{"fastq_out",	no_argument, 		NULL,	'F'},
+	{"collapse",	no_argument, 		NULL,	'C'},
+	{"min_q",	required_argument, 	NULL,	'Q'},
+	{"lq_base",	required_argument, 	NULL,	'E'},
+	{"fail_t",	required_argument, 	NULL,	'T'},
+	{"by_reason",	no_argument, 		NULL,	'J'},
 
 	{"left",	required_argument, 	NULL,	'l'},
 	{"right",	required_argument, 	NULL,	'r'},
 
 	{"spacer",	optional_argument, 	NULL,	's'},
+	{"umi",		required_argument, 	NULL,	'u'},
+	{"designs",	required_argument, 	NULL,	'D'},
+
+	{"smap",	required_argument, 	NULL,	'P'},
+	{"imm",		optional_argument, 	NULL,	'I'},
+	{"rci",		no_argument, 		NULL,	'X'},
 
 	{"roi_min",	required_argument, 	NULL,	'm'},
 	{"roi_max",	required_argument, 	NULL,	'M'},
@@ -56,6 +85,12 @@ static struct option long_options[] = {
 	{"no_mmr",	no_argument,		NULL,	'R'},
 	{"no_mms",	no_argument,		NULL,	'S'},
 
+	{"ed_l",	optional_argument,	NULL,	'a'},
+	{"ed_r",	optional_argument,	NULL,	'b'},
+	{"ed_s",	optional_argument,	NULL,	'c'},
+
+	{"both",	no_argument,		NULL,	'B'},
+
 	{"quiet",	no_argument,		NULL,	'q'},
 	{"help",	no_argument,		NULL,	'h'},
 	{0,		0,			0,	0 }
@@ -19,6 +19,12 @@ int main(int argc, char** argv) {
 	
 	uint8_t thr =	15;
 	uint32_t load = 10000;
+
+	uint32_t bloom = 0;
+	uint16_t parts = 64;
+	char* tmp =	NULL;
+	bool count =	false;
+	uint64_t cache = 16384;
 	
 	bool z_in =	false;
 	string in_sep = "\t";
@@ -28,7 +34,7 @@ int main(int argc, char** argv) {
 	int opt = 0;
 	while (1) {
 		int long_index = 0;
-		opt = getopt_long(argc, argv, "1:2:3::4::t::f::I::qh", long_options, &long_index);
+		opt = getopt_long(argc, argv, "1:2:3::4::t::f::I::b::p::T::C::cqh", long_options, &long_index);
 		if (opt == -1) { break; }
 		switch(opt) {
 			case '1' 	: in1 = optarg; 		break;
@@ -41,6 +47,12 @@ int main(int argc, char** argv) {
 
 			case 'I'	: in_sep = string(optarg);	break;
 
+			case 'b'	: bloom = optarg ? atoi(optarg) : 16;	break;
+			case 'p'	: parts = atoi(optarg);		break;
+			case 'T'	: tmp = optarg;			break;
+			case 'C'	: cache = atol(optarg);		break;
+			case 'c'	: count = true;			break;
+
 			case 'q'	: quiet = true;			break;
 
 			case 'h'	: cout << gu_usage << endl;	exit(GUEC_NO_ERROR);
@@ -67,6 +79,11 @@ int main(int argc, char** argv) {
 	mm.set_n_threads(thr);
 	mm.set_load_factor(load);
 	mm.set_input_sep(in_sep);
+	mm.set_bloom_bits(bloom);
+	mm.set_n_parts(parts);
+	if (tmp) { mm.set_tmp_dir(string(tmp)); }
+	mm.set_count_only(count);
+	mm.set_cache_limit(cache << 20);
 
 	// blurb parameters if allowed
 	if (!quiet) { mm.print_params(); }
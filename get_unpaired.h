@@ -7,8 +7,9 @@
 
 string cmd = string(getenv("_"));
 static string gu_usage = 
-	"Usage:	" + cmd + "	[-1234Itfqh] [--in1] [--in2] [--out1] [--out2]\n"
-	"			[--in_sep] [--threads] [--load] [--quiet] [--help]\n\n"
+	"Usage:	" + cmd + "	[-1234ItfpTCbcqh] [--in1] [--in2] [--out1] [--out2]\n"
+	"			[--in_sep] [--threads] [--load] [--parts] [--tmp]\n"
+	"			[--cache] [--bloom] [--count] [--quiet] [--help]\n\n"
 	"	long		short	type		description\n"
 	"	====		=====	====		===========\n"
 	"Required:\n"
@@ -20,6 +21,13 @@ static string gu_usage =
 	"	--in_sep	-I	<string|char>>	input file delimiter (tab)\n"
 	"	--threads	-t	<integer>	set number of threads (15)\n"
 	"	--load		-f	<integer>	load factor (10,000)\n\n"
+	"	--bloom		-b	[<integer>]	use Bloom filters of this many bits\n"
+	"					per read instead of key sets (off, 16)\n"
+	"	--parts		-p	<integer>	number of on-disk partitions for --bloom (64)\n"
+	"	--tmp		-T	<dirname>	directory for partitions and caches ($TMPDIR or /tmp)\n"
+	"	--cache		-C	<integer>	size limit in MB of the cache of an inflated\n"
+	"					.gz input, 0 re-inflates it every pass (16384)\n"
+	"	--count		-c	<flag>		only report the number of unpaired reads\n\n"
 	"	--quiet		-q	<flag>		suppress parameters output\n"
 	"	--help		-h	<flag>		print this message and exit\n";
 
@@ -31,6 +39,11 @@ static struct option long_options[] = {
 	{"threads",	optional_argument,	NULL,	't'},
 	{"load",	optional_argument,	NULL,	'f'},
 	{"in_sep",	optional_argument,	NULL,	'I'},
+	{"bloom",	optional_argument,	NULL,	'b'},
+	{"parts",	optional_argument,	NULL,	'p'},
+	{"tmp",		optional_argument,	NULL,	'T'},
+	{"cache",	optional_argument,	NULL,	'C'},
+	{"count",	no_argument,		NULL,	'c'},
 	{"quiet",	no_argument,		NULL,	'q'},
 	{"help",	no_argument,		NULL,	'h'},
 	{0,		0,			0, 	0 }
@@ -0,0 +1,88 @@
+#include <vector>
+#include <cstring>
+#include "key_table.h"
+using namespace std;
+
+// initial number of slots
+static const size_t KT_MIN_SLOTS = 1024;
+
+Key_table::Key_table() {
+	slots.assign(KT_MIN_SLOTS, KT_EMPTY);
+	slot_mask = KT_MIN_SLOTS - 1;
+}
+
+Key_table::~Key_table() {}
+
+/* first slot probed for a key, the words are combined and mixed
+ * (splitmix64 finalizer)
+ * arguments:
+ * 	key
+ * 	*/
+uint64_t Key_table::slot_of(const PACKED_KEY& k) const {
+	uint64_t h = 0;
+	for (size_t i = 0; i < KT_WORDS; ++i) {
+		h = (h ^ k.w[i]) * 0x9e3779b97f4a7c15ULL;
+		h ^= h >> 32;
+	}
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	h ^= h >> 31;
+	return h & slot_mask;
+}
+
+/* moves the entries to a new number of slots
+ * arguments:
+ * 	number of slots, a power of 2
+ * 	*/
+void Key_table::rehash(size_t n_slots) {
+	slots.assign(n_slots, KT_EMPTY);
+	slot_mask = n_slots - 1;
+	for (uint32_t e = 0; e < keys.size(); ++e) {
+		uint64_t s = slot_of(keys[e]);
+		while (slots[s] != KT_EMPTY) { s = (s + 1) & slot_mask; }
+		slots[s] = e;
+	}
+}
+
+/* drops all entries, keeps the allocated memory
+ * takes no arguments
+ * */
+void Key_table::clear() {
+	slots.assign(slots.size(), KT_EMPTY);
+	keys.clear();
+	counts.clear();
+}
+
+/* counts a key
+ * returns the entry number of the key
+ * arguments:
+ * 	key
+ * 	count to add
+ * 	*/
+uint32_t Key_table::add(const PACKED_KEY& k, uint32_t n) {
+	uint64_t s = slot_of(k);
+	while (slots[s] != KT_EMPTY) {
+		uint32_t e = slots[s];
+		if (memcmp(keys[e].w, k.w, sizeof(k.w)) == 0) {
+			counts[e] += n;
+			return e;
+		}
+		s = (s + 1) & slot_mask;
+	}
+
+	uint32_t e = keys.size();
+	keys.push_back(k);
+	counts.push_back(n);
+	slots[s] = e;
+	if (2 * keys.size() > slots.size()) { rehash(2 * slots.size()); }
+	return e;
+}
+
+/* entries run from 0 to size() in the order they were added */
+size_t Key_table::size() const { return keys.size(); }
+
+const PACKED_KEY& Key_table::key(uint32_t e) const { return keys[e]; }
+
+uint32_t Key_table::count(uint32_t e) const { return counts[e]; }
@@ -0,0 +1,62 @@
+#ifndef __KEY_TABLE_H__
+#define __KEY_TABLE_H__
+
+#include <vector>
+#include <cstdint>
+using namespace std;
+
+// words of a packed key, the last one holds the record layout
+static const size_t KT_WORDS = 4;
+
+// bases packed 2 bits each into the words before the layout word
+static const size_t KT_MAX_BASES = 32 * (KT_WORDS - 1);
+
+// reads per record and bases per read a layout word describes
+static const size_t KT_MAX_READS = 4;
+static const size_t KT_MAX_READ_LEN = 63;
+
+// sample codes, 0 is the undefined sample
+static const uint32_t KT_MAX_SAMPLE = (1 << 20) - 1;
+
+// slot without an entry
+static const uint32_t KT_EMPTY = ~static_cast<uint32_t>(0);
+
+/* fixed width key of a collapsed record, the read sequences are packed 2 bits
+ * per base one after the other and the last word is the layout:
+ * 	bits 0-2	number of reads
+ * 	bits 3-6	quality fail flag per read (its sequence is not packed)
+ * 	bits 7-30	length of each read, 6 bits each
+ * 	bits 31-50	sample code (0: undefined, else sample number + 1)
+ * unused bits are 0 so equal records have equal keys */
+typedef struct packed_key {
+	uint64_t w[KT_WORDS];
+} PACKED_KEY;
+
+/* Flat open-addressing table counting packed record keys, used by the
+ * collapser in place of a string keyed hash. Entries are numbered in the
+ * order they are added and kept in a vector with their counts, the slots
+ * hold entry numbers only. Linear probing over a power of 2 number of slots
+ * at most half full; entries are never removed, only the whole table is
+ * cleared, keeping its memory for the next bite. */
+class Key_table {
+	public:
+		Key_table();
+		virtual ~Key_table();
+
+		void clear();
+		uint32_t add(const PACKED_KEY& k, uint32_t n);
+
+		size_t size() const;
+		const PACKED_KEY& key(uint32_t e) const;
+		uint32_t count(uint32_t e) const;
+
+	private:
+		vector<PACKED_KEY> keys;
+		vector<uint32_t> counts;
+		vector<uint32_t> slots;
+		uint64_t slot_mask;
+
+		uint64_t slot_of(const PACKED_KEY& k) const;
+		void rehash(size_t n_slots);
+};
+#endif //__KEY_TABLE_H__
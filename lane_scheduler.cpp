@@ -0,0 +1,248 @@
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include "lane_scheduler.h"
+#include "map_merger.h"
+#include "utils.h"
+using namespace std;
+using namespace utils;
+
+/* constructor
+ * arguments:
+ * 	threads shared by the lanes
+ * 	lanes run at a time (0: threads / 4)
+ * 	memory budget of all lanes in bytes (0: the memory available)
+ * 	*/
+Lane_scheduler::Lane_scheduler(uint8_t threads, uint8_t concurrent, uint64_t memory) {
+	n_threads = threads ? threads : 1;
+	n_concurrent = concurrent;
+	if (!n_concurrent) { n_concurrent = (n_threads / 4) ? (n_threads / 4) : 1; }
+	memory_budget = memory;
+
+	tmp_dir = "";
+	n_parts = 0;
+	window = 0;
+	load_factor = 10000;
+	INPUT_SEP = "\t";
+	OUTPUT_SEP = "\t";
+
+	memory_used = 0;
+	n_running = 0;
+	n_started = 0;
+}
+
+Lane_scheduler::~Lane_scheduler() {
+	for (size_t i = 0; i < lanes.size(); ++i) {
+		if (lanes.at(i)->mm) { delete(lanes.at(i)->mm); }
+		delete(lanes.at(i));
+	}
+}
+
+/* reads the lanes, one per line as
+ * 	R1 R2 out [out1 out2]
+ * separated by white space, - for no unpaired output. Empty lines and lines
+ * starting with # are skipped
+ * arguments:
+ * 	filename
+ * 	*/
+void Lane_scheduler::load(char* fn) {
+	string line;
+	ifstream in;
+	attach_stream<ifstream>(fn, in, std::ifstream::in);
+
+	while (getline(in, line)) {
+		if (line.empty() || (line[0] == '#')) { continue; }
+
+		istringstream ss(line);
+		vector<string> f;
+		string s;
+		while (ss >> s) { f.push_back(s); }
+		if (f.empty()) { continue; }
+		if ((f.size() != 3) && (f.size() != 5)) {
+			report_error(__FILE__, __func__, LS_CORRUPT_LANES);
+			report_error(__FILE__, __func__, line);
+			exit(LSEC_CORRUPT_LANES);
+		}
+
+		LANE* l = new LANE;
+		l->R1 = f.at(0);
+		l->R2 = f.at(1);
+		l->out = f.at(2);
+		if ((f.size() == 5) && (f.at(3) != "-")) { l->out1 = f.at(3); }
+		if ((f.size() == 5) && (f.at(4) != "-")) { l->out2 = f.at(4); }
+		l->z_in = (l->R1.find(".gz") != string::npos) || (l->R2.find(".gz") != string::npos);
+		l->z_out = (l->out.find(".gz") != string::npos);
+		l->memory = 0;
+		l->mm = NULL;
+		lanes.push_back(l);
+	}
+	in.close();
+
+	if (lanes.empty()) {
+		report_error(__FILE__, __func__, LS_NO_LANES + string(fn));
+		exit(LSEC_NO_LANES);
+	}
+	started.assign(lanes.size(), false);
+}
+
+/* setters passed on to the merger of every lane, n_parts 0 plans the
+ * partitions of each lane from its share of the memory */
+void Lane_scheduler::set_tmp_dir(const string& d) { tmp_dir = d; }
+
+void Lane_scheduler::set_n_parts(uint16_t n) { n_parts = n; }
+
+void Lane_scheduler::set_window(uint32_t w) { window = w; }
+
+void Lane_scheduler::set_load_factor(uint32_t l) { load_factor = l; }
+
+void Lane_scheduler::set_input_sep(const string& sep) { INPUT_SEP = sep; }
+
+void Lane_scheduler::set_output_sep(const string& sep) { OUTPUT_SEP = sep; }
+
+size_t Lane_scheduler::size() const { return lanes.size(); }
+
+/* sets up the merger of every lane with its share of the threads and
+ * plans its join for its share of the memory budget
+ * arguments:
+ * 	boolean suppress parameters output
+ * 	*/
+void Lane_scheduler::plan_lanes(bool quiet) {
+	if (n_concurrent > lanes.size()) { n_concurrent = lanes.size(); }
+	uint8_t lane_threads = (n_threads / n_concurrent) ? (n_threads / n_concurrent) : 1;
+	if (!memory_budget) { memory_budget = available_memory() * MM_MEMORY_SHARE; }
+
+	for (size_t i = 0; i < lanes.size(); ++i) {
+		LANE* l = lanes.at(i);
+		if (window && (!l->out1.empty() || !l->out2.empty())) {
+			report_error(__FILE__, __func__, LS_UNPAIRED_WINDOW);
+			exit(LSEC_UNPAIRED_WINDOW);
+		}
+
+		l->mm = new Map_merger(
+				const_cast<char*>(l->R1.c_str()),
+				const_cast<char*>(l->R2.c_str()),
+				const_cast<char*>(l->out.c_str()));
+		if (!tmp_dir.empty()) { l->mm->set_tmp_dir(tmp_dir); }
+		l->mm->set_n_threads(lane_threads);
+		l->mm->set_load_factor(load_factor);
+		l->mm->set_window(window);
+		l->mm->set_unpaired_outputs(
+				l->out1.empty() ? NULL : const_cast<char*>(l->out1.c_str()),
+				l->out2.empty() ? NULL : const_cast<char*>(l->out2.c_str()));
+
+		if (n_parts) {
+			l->mm->set_n_parts(n_parts);
+		} else if (!window) {
+			l->mm->set_memory(memory_budget / n_concurrent);
+			l->mm->plan_join(l->z_in);
+		}
+		l->mm->set_input_sep(INPUT_SEP);
+		l->mm->set_output_sep(OUTPUT_SEP);
+		l->memory = l->mm->get_plan_memory();
+
+		// --parts and --window are not planned, such lanes are counted
+		// at their share of the budget
+		if (!l->memory) { l->memory = memory_budget / n_concurrent; }
+
+		if (!quiet) {
+			cout << "== lane " << i + 1 << " ==" << endl;
+			l->mm->print_params();
+			cout << endl;
+		}
+	}
+
+	if (!quiet) {
+		cout << "lanes:\t\t" << lanes.size() << endl;
+		cout << "concurrent:\t" << +n_concurrent << endl;
+		cout << "memory budget:\t" << memory_budget / 1048576 << " MB" << endl;
+		cout << endl;
+	}
+}
+
+/* waits for a lane the memory budget has room for and starts it, lanes
+ * are taken in file order unless a later one fits where the next does not.
+ * returns NULL when every lane has been started
+ * takes no arguments
+ * */
+LANE* Lane_scheduler::next_lane() {
+	// critical
+	boost::unique_lock<boost::mutex> lock(mtx);
+	while (n_started < lanes.size()) {
+		for (size_t i = 0; i < lanes.size(); ++i) {
+			if (started.at(i)) { continue; }
+
+			LANE* l = lanes.at(i);
+			if (	n_running && memory_budget &&
+				(memory_used + l->memory > memory_budget)) { continue; }
+
+			started.at(i) = true;
+			++n_started;
+			++n_running;
+			memory_used += l->memory;
+			return l;
+		}
+		lane_done.wait(lock);
+	}
+	return NULL;
+	// end critical
+}
+
+/* returns the memory of a finished lane to the budget and reports it
+ * arguments:
+ * 	lane
+ * 	boolean suppress the statistics
+ * 	*/
+void Lane_scheduler::finish_lane(LANE* l, bool quiet) {
+	if (!quiet) {
+		// critical
+		print_mtx.lock();
+		cout << "done:\t\t" << l->R1 << " " << l->R2 << " -> " << l->out << endl;
+		l->mm->print_stats();
+		cout << endl;
+		print_mtx.unlock();
+		// end critical
+	}
+	delete(l->mm);
+	l->mm = NULL;
+
+	// critical
+	mtx.lock();
+	memory_used -= l->memory;
+	--n_running;
+	mtx.unlock();
+	// end critical
+	lane_done.notify_all();
+}
+
+/* a thread of the scheduler, runs lanes until none is left
+ * arguments:
+ * 	boolean suppress the statistics
+ * 	*/
+void Lane_scheduler::worker(bool quiet) {
+	LANE* l;
+	while ((l = next_lane()) != NULL) {
+		l->mm->merge_id_maps(l->z_in, l->z_out);
+		finish_lane(l, quiet);
+	}
+}
+
+/* plans the lanes and pairs them, n_concurrent at a time
+ * arguments:
+ * 	boolean suppress parameters output
+ * 	*/
+void Lane_scheduler::run(bool quiet) {
+	plan_lanes(quiet);
+
+	boost::thread_group tgroup;
+	for (uint8_t i = 0; i < n_concurrent; ++i) {
+		tgroup.create_thread(boost::bind(&Lane_scheduler::worker, this, quiet));
+	}
+	tgroup.join_all();
+
+	// one process runs all lanes, its peak is not that of a lane
+	if (!quiet) { cout << "process peak RSS:\t" << peak_rss() / 1048576 << " MB" << endl; }
+}
@@ -0,0 +1,88 @@
+#ifndef __LANE_SCHEDULER_H__
+#define __LANE_SCHEDULER_H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <boost/thread.hpp>
+#include "map_merger.h"
+using namespace std;
+
+static string LS_CORRUPT_LANES = 	"Corrupt lanes file, expected: R1 R2 out [out1 out2]";
+static string LS_NO_LANES = 		"No lanes in ";
+static string LS_UNPAIRED_WINDOW = 	"Unpaired outputs of a lane need the partitioned join, drop --window,-w";
+
+enum LS_ERRORS {
+	LSEC_CORRUPT_LANES	=	30,
+	LSEC_NO_LANES		=	31,
+	LSEC_UNPAIRED_WINDOW	=	32
+};
+
+// one R1/R2 pair of a lanes file and its merger
+typedef struct lane {
+	string R1;
+	string R2;
+	string out;
+	string out1;		// empty for no unpaired output
+	string out2;
+	bool z_in;
+	bool z_out;
+	uint64_t memory;	// predicted by plan_join
+	Map_merger* mm;
+} LANE;
+
+/* Pairs several lanes (R1/R2 pairs with their own outputs) in one process.
+ * Up to n_concurrent lanes run at a time, each with its share of the threads
+ * and planned for its share of the memory budget. A lane is only started
+ * while the predicted memory of the running lanes leaves room for it (or
+ * when nothing runs), so the lanes together stay within the budget. Running
+ * lanes side by side lets the input scan of one overlap with the table
+ * build of another. The outputs of a lane are those of combine_R1_R2 run on
+ * it alone. */
+class Lane_scheduler {
+	public:
+		Lane_scheduler(uint8_t threads, uint8_t concurrent, uint64_t memory);
+		virtual ~Lane_scheduler();
+
+		void load(char* fn);
+		void set_tmp_dir(const string& d);
+		void set_n_parts(uint16_t n);
+		void set_window(uint32_t w);
+		void set_load_factor(uint32_t l);
+		void set_input_sep(const string& sep);
+		void set_output_sep(const string& sep);
+
+		void run(bool quiet);
+		size_t size() const;
+
+	private:
+		vector<LANE*> lanes;
+		vector<bool> started;
+
+		uint8_t n_threads;
+		uint8_t n_concurrent;
+		uint64_t memory_budget;
+
+		string tmp_dir;
+		uint16_t n_parts;
+		uint32_t window;
+		uint32_t load_factor;
+		string INPUT_SEP;
+		string OUTPUT_SEP;
+
+		// admission of the lanes
+		boost::mutex mtx;
+		boost::condition_variable lane_done;
+		uint64_t memory_used;
+		uint8_t n_running;
+		size_t n_started;
+
+		// serializes the reports of the lanes
+		boost::mutex print_mtx;
+
+		void plan_lanes(bool quiet);
+		void worker(bool quiet);
+		LANE* next_lane();
+		void finish_lane(LANE* l, bool quiet);
+};
+#endif //__LANE_SCHEDULER_H__
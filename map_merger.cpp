@@ -7,9 +7,63 @@
 #include <boost/thread.hpp>
 #include <boost/bind.hpp>
 #include "utils.h"
+#include <unistd.h>
+#include <cstdio>
+#include <cctype>
+#include <iomanip>
+#include <algorithm>
+#include <set>
+#include <cstdlib>
 using namespace std;
 using namespace utils;
 
+// instances created so far, numbers the temp files of concurrent mergers
+static uint32_t n_instances = 0;
+
+// temp files (partitions, caches) of all mergers not removed yet, an error
+// exit anywhere in the process removes them
+static boost::mutex tmp_files_mtx;
+static set<string> tmp_files;
+static bool tmp_files_at_exit = false;
+
+/* removes the temp files left at exit, a thread may hold the lock when
+ * another one exits so it is not waited for */
+static void remove_tmp_files() {
+	bool locked = tmp_files_mtx.try_lock();
+	for (set<string>::iterator it = tmp_files.begin(); it != tmp_files.end(); ++it) {
+		remove(it->c_str());
+	}
+	tmp_files.clear();
+	if (locked) { tmp_files_mtx.unlock(); }
+}
+
+/* registers a temp file before it is created
+ * arguments:
+ * 	file name
+ * 	*/
+static void add_tmp_file(const string& fn) {
+	// critical
+	boost::lock_guard<boost::mutex> lock(tmp_files_mtx);
+	if (!tmp_files_at_exit) {
+		atexit(remove_tmp_files);
+		tmp_files_at_exit = true;
+	}
+	tmp_files.insert(fn);
+	// end critical
+}
+
+/* removes a temp file and drops it from the registry
+ * arguments:
+ * 	file name
+ * 	*/
+static void remove_tmp_file(const string& fn) {
+	remove(fn.c_str());
+	// critical
+	boost::lock_guard<boost::mutex> lock(tmp_files_mtx);
+	tmp_files.erase(fn);
+	// end critical
+}
+
 //Map_merger::Map_merger(char* i1, char* i2, int m_lines, int rthr, int wthr) {
 /* constuctor
  * takes the input filenames for the 2 id mapping files and a
@@ -21,36 +75,40 @@ Map_merger::Map_merger(char* i1, char* i2, char* out) {
 	unpR1 = NULL;
 	unpR2 = NULL;
 
-	lines_read = 0;
-
 	//defaults
-	max_lines = 75000000;
 	n_threads = 10;
 	load_factor = 10000;
+	window = 0;
+	has_prefix = false;
+	n_parts = MM_DEFAULT_PARTS;
+	z_unpR1 = false;
+	z_unpR2 = false;
+	bloom_bits = 0;
+	cache_limit = MM_CACHE_LIMIT;
+	cache_out = NULL;
+	cache_size = 0;
+	cache_full = false;
+	cached[0] = false;
+	cached[1] = false;
+	plan = MM_PLAN_PARTITIONED;
+	plan_records = 0;
+	plan_rec_len = 0;
+	plan_memory = 0;
+	memory_budget = 0;
+	bloom_bytes = 0;
+	count_only = false;
+	n_unpaired_R1 = 0;
+	n_unpaired_R2 = 0;
+	peak_entries = 0;
+	peak_bytes = 0;
+	peak_overhead = 0;
+	n_dup_R1 = 0;
+	tmp_dir = getenv("TMPDIR") ? string(getenv("TMPDIR")) : string("/tmp");
+	run_id = to_string(getpid()) + "." + to_string(__sync_fetch_and_add(&n_instances, 1));
 	INPUT_SEP = "\t";
 	OUTPUT_SEP = "\t";
 
 	init_hashes();
-	R1_hash->reserve(max_lines);
-}
-
-Map_merger::Map_merger(char* i1, char* i2, char* out, uint32_t mlines) {
-	R1fn = i1;
-	R2fn = i2;
-	outfile = out;
-	unpR1 = NULL;
-	unpR2 = NULL;
-
-	lines_read = 0;
-
-	max_lines = mlines;
-	n_threads = 10;
-	load_factor = 10000;
-	INPUT_SEP = "\t";
-	OUTPUT_SEP = "\t";
-
-	init_hashes();
-	R1_hash->reserve(max_lines);
 }
 
 Map_merger::Map_merger(char* i1, char* i2, char* o1, char* o2) {   
@@ -60,34 +118,54 @@ Map_merger::Map_merger(char* i1, char* i2, char* o1, char* o2) {
 	unpR2 = o2;
 	outfile = NULL;
 
-	lines_read = 0;
-
 	//defaults
-	max_lines = 75000000;
 	n_threads = 10;
 	load_factor = 10000;
+	window = 0;
+	has_prefix = false;
+	n_parts = MM_DEFAULT_PARTS;
+	z_unpR1 = false;
+	z_unpR2 = false;
+	bloom_bits = 0;
+	cache_limit = MM_CACHE_LIMIT;
+	cache_out = NULL;
+	cache_size = 0;
+	cache_full = false;
+	cached[0] = false;
+	cached[1] = false;
+	plan = MM_PLAN_PARTITIONED;
+	plan_records = 0;
+	plan_rec_len = 0;
+	plan_memory = 0;
+	memory_budget = 0;
+	bloom_bytes = 0;
+	count_only = false;
+	n_unpaired_R1 = 0;
+	n_unpaired_R2 = 0;
+	peak_entries = 0;
+	peak_bytes = 0;
+	peak_overhead = 0;
+	n_dup_R1 = 0;
+	tmp_dir = getenv("TMPDIR") ? string(getenv("TMPDIR")) : string("/tmp");
+	run_id = to_string(getpid()) + "." + to_string(__sync_fetch_and_add(&n_instances, 1));
 	INPUT_SEP = "\t";
 	OUTPUT_SEP = "\t";
 
 	init_hashes();
-	R1_hash->reserve(max_lines);
 }
 
 void Map_merger::init_hashes() {
 	/* initialize internal hashes on the heap */
-	R1_hash = new umsvs;
-
-	unpaired_R1 = new uss;
-	unpaired_R2 = new uss;
+	unpaired_R1 = new READ_SET;
+	unpaired_R2 = new READ_SET;
 
-	R1_ids = new uss;
-	R2_ids = new uss;
+	R1_ids = new READ_SET;
+	R2_ids = new READ_SET;
 }
 
 /* destructor
  * cleans all the stuff we initialized on the heap in the cosntructor */
 Map_merger::~Map_merger() {
-	delete(R1_hash);
 	delete(unpaired_R1);
 	delete(unpaired_R2);
 	delete(R1_ids);
@@ -112,7 +190,7 @@ void Map_merger::print_params() {
 	cout << endl;
 	
 	cout << "unpaired R2:\t";
-	if (unpR2) { cout << unpR1; } else { cout << "stdout"; }
+	if (unpR2) { cout << unpR2; } else { cout << "stdout"; }
 	cout << endl;
 	
 	cout << "merged maps:\t";
@@ -122,15 +200,64 @@ void Map_merger::print_params() {
 
 	cout << "input sep:\t\"" << INPUT_SEP << "\"" << endl;
 	cout << "output sep:\t\"" << OUTPUT_SEP << "\"" << endl;
-	cout << "max lines:\t" << max_lines << endl;
+	if (plan_records && !window) {
+		cout << "plan:\t\t";
+		if (plan == MM_PLAN_MEMORY) { cout << "in-memory join" << endl; }
+		else { cout << "partitioned join" << endl; }
+		cout << "R1 records:\t~" << plan_records << endl;
+		cout << "memory budget:\t" << memory_budget / 1048576 << " MB" << endl;
+		cout << "predicted:\t" << plan_memory / 1048576 << " MB" << endl;
+	}
+	if (plan == MM_PLAN_PARTITIONED) { cout << "partitions:\t" << n_parts << endl; }
+	if (!plan_note.empty()) { cout << "plan note:\t" << plan_note << endl; }
+	cout << "temp dir:\t" << tmp_dir << endl;
+	if (window) { cout << "merge window:\t" << window << endl; }
+	if (bloom_bits) { cout << "Bloom bits:\t" << bloom_bits << endl; }
 	cout << "load factor:\t" << load_factor << endl;
 	cout << "N threads:\t" << +n_threads << endl;
 }
 
-/* setter for the maximum number of lines per iteration
- * higher numbers lead to more memory usage
- * default is 10,000,000 (see constructor */
-void Map_merger::set_max_lines(uint32_t mlines) { max_lines = mlines; }
+/* prints the memory used by the largest R1 partition table of the
+ * partitioned join, the peak RSS is the process's (utils::peak_rss)
+ * takes no arguments
+ * */
+void Map_merger::print_stats() {
+	if (window) { return; }
+	if (plan == MM_PLAN_MEMORY) { cout << "R1 table:\t"; } else { cout << "largest partition:\t"; }
+	cout << peak_entries << " records, ";
+	cout << peak_bytes << " bytes, ";
+	cout << fixed << setprecision(1) << peak_overhead << " bytes overhead per record" << endl;
+	if (n_dup_R1) {
+		cout << "duplicate R1:\t" << n_dup_R1 << " records";
+		if (unpR1) { cout << " (written as unpaired R1)"; } else { cout << " (dropped)"; }
+		cout << endl;
+	}
+}
+
+/* setters for the partitioned join, the number of partitions bounds the
+ * memory used (a partition of R1 per thread) and the temp directory holds
+ * the partition files */
+void Map_merger::set_n_parts(uint16_t n) { n_parts = n ? n : 1; }
+
+void Map_merger::set_tmp_dir(const string& d) { tmp_dir = d; }
+
+/* setter for the unpaired outputs of merge_id_maps, a .gz name gives a
+ * compressed output and NULL no output */
+void Map_merger::set_unpaired_outputs(char* o1, char* o2) {
+	unpR1 = o1;
+	unpR2 = o2;
+	z_unpR1 = o1 && (string(o1).find(".gz") != string::npos);
+	z_unpR2 = o2 && (string(o2).find(".gz") != string::npos);
+}
+
+/* setters for get_unpaired_reads, bits per read of the Bloom filters (0
+ * keeps all keys in sets) and only counting the unpaired records */
+void Map_merger::set_bloom_bits(uint32_t b) { bloom_bits = b; }
+
+void Map_merger::set_count_only(bool c) { count_only = c; }
+
+/* setter for the merge-join lookahead, 0 turns the merge-join off */
+void Map_merger::set_window(uint32_t w) { window = w; }
 
 /* setter for the number of running threads */
 void Map_merger::set_n_threads(uint8_t nthr) { n_threads = nthr; }
@@ -141,132 +268,815 @@ void Map_merger::set_load_factor(uint32_t i) { load_factor = i; }
 void Map_merger::set_input_sep(const string& sep) { INPUT_SEP = sep; }
 
 void Map_merger::set_output_sep(const string& sep) { OUTPUT_SEP = sep; }
-/* reads an id map
- * takes no arguments */
-template<class T>void Map_merger::read_id_map(T& inR1) {
-	string line;
-	vector<string>* buffer = new vector<string>;
+/* packs a read ID into a 64 bit key. Illumina IDs
+ * 	<prefix>:lane:tile:x:y
+ * sharing the prefix of the first R1 ID are stored as lane (5 bits), tile
+ * (16), x (21) and y (21) bits with the top bit clear. Anything else gets a
+ * 63 bit hash with the top bit set and is verified against the full ID
+ * wherever records are paired.
+ * arguments:
+ * 	read ID
+ * 	*/
+uint64_t Map_merger::encode_key(const string& id) const {
+	static const uint8_t bits[4] = {5, 16, 21, 21};
+	uint64_t key = 0;
+
+	size_t end = id.length();
+	size_t p = end;
+	bool ok = has_prefix;
+	for (int f = 3; ok && (f >= 0); --f) {
+		p = (end == 0) ? string::npos : id.rfind(':', end - 1);
+		ok = (p != string::npos) && (end - p - 1 > 0) && (end - p - 1 <= 7);
+
+		// plain decimal numbers only, so that decode_key gives back the ID
+		ok = ok && ((id[p + 1] != '0') || (end - p - 1 == 1));
+		uint64_t v = 0;
+		for (size_t i = p + 1; ok && (i < end); ++i) {
+			ok = isdigit(id[i]);
+			v = v * 10 + (id[i] - '0');
+		}
+		ok = ok && (v < (static_cast<uint64_t>(1) << bits[f]));
+
+		uint8_t shift = 0;
+		for (int g = f + 1; g < 4; ++g) { shift += bits[g]; }
+		key |= v << shift;
+		end = p;
+	}
+	ok = ok && (id.compare(0, end, key_prefix) == 0) && (end == key_prefix.length());
+
+	if (ok) { return key; }
+	return (boost::hash<string>()(id) & ~RK_HASHED) | RK_HASHED;
+}
+
+/* gives back the read ID of a packed key
+ * arguments:
+ * 	key, must not be a hashed one
+ * 	*/
+string Map_merger::decode_key(uint64_t key) const {
+	return	key_prefix + ":" +
+		to_string((key >> 58) & 0x1F) + ":" +
+		to_string((key >> 42) & 0xFFFF) + ":" +
+		to_string((key >> 21) & 0x1FFFFF) + ":" +
+		to_string(key & 0x1FFFFF);
+}
+
+/* takes the ID prefix for packed keys from the first R1 record
+ * arguments:
+ * 	boolean zipped input
+ * 	*/
+void Map_merger::learn_key_prefix(bool z_in) {
+	string line, id, fields;
+	ifstream i1;
+	igzstream z1;
 
-	// temporary hash
-	umsvs* temp_map = new umsvs;
+	if (z_in) {
+		attach_stream<igzstream>(R1fn, z1, ios_base::in);
+		getline(z1, line);
+		z1.close();
+	} else {
+		attach_stream<ifstream>(R1fn, i1, ios_base::in);
+		getline(i1, line);
+		i1.close();
+	}
 
-	vector<string> chunks;
+	split_record(line, id, fields);
+	has_prefix = false;
+	key_prefix.clear();
 
-	// check if stream is good and we have not reached the maximum number of lines to rad
-	while (inR1.good() && (lines_read < max_lines)) {
+	// the prefix ends at the 4th ':' from the end
+	size_t p = id.length();
+	for (uint8_t f = 0; (f < 4) && (p != string::npos) && (p > 0); ++f) { p = id.rfind(':', p - 1); }
+	if ((p != string::npos) && (p > 0)) {
+		key_prefix = id.substr(0, p);
+		has_prefix = true;
+	}
+}
+
+/* appends a record to a partition buffer in binary form: key, the read ID
+ * for hashed keys (length, ID), fields length, fields (still delimited by
+ * INPUT_SEP)
+ * arguments:
+ * 	buffer
+ * 	key
+ * 	read ID
+ * 	fields after the read ID
+ * 	*/
+static void put_record(string& buf, uint64_t key, const string& id, const string& fields) {
+	buf.append(reinterpret_cast<const char*>(&key), sizeof(key));
+	if (key & RK_HASHED) {
+		uint32_t il = id.length();
+		buf.append(reinterpret_cast<const char*>(&il), sizeof(il));
+		buf += id;
+	}
+	uint32_t fl = fields.length();
+	buf.append(reinterpret_cast<const char*>(&fl), sizeof(fl));
+	buf += fields;
+}
+
+/* reads a record written by put_record
+ * returns false at the end of the partition
+ * arguments:
+ * 	partition stream
+ * 	key
+ * 	read ID (hashed keys only)
+ * 	fields after the read ID
+ * 	*/
+static bool get_record(istream& in, uint64_t& key, string& id, string& fields) {
+	uint32_t il, fl;
+	if (!in.read(reinterpret_cast<char*>(&key), sizeof(key))) { return false; }
+	id.clear();
+	if (key & RK_HASHED) {
+		in.read(reinterpret_cast<char*>(&il), sizeof(il));
+		id.resize(il);
+		in.read(&id[0], il);
+	}
+	in.read(reinterpret_cast<char*>(&fl), sizeof(fl));
+	fields.resize(fl);
+	in.read(&fields[0], fl);
+	return in.good();
+}
+
+/* splits a record into the read ID and the remaining fields
+ * arguments:
+ * 	record
+ * 	read ID
+ * 	fields after the read ID
+ * 	*/
+void Map_merger::split_record(const string& line, string& key, string& fields) const {
+	size_t p = line.find(INPUT_SEP);
+	key = line.substr(0, p);
+	fields = (p == string::npos) ? string() : line.substr(p + INPUT_SEP.length());
+}
+
+/* spreads the records of an input over the partitions by key, the input
+ * is read under mtx and every partition is appended under its own lock
+ * arguments:
+ * 	input stream
+ * 	partition streams
+ * 	records per partition (updated)
+ * 	*/
+template<class T> void Map_merger::partition(T& in, vector<ofstream*>& parts, vector<uint64_t>& counts) {
+	string line;
+	string id;
+	string fields;
+	vector<string>* buffer = new vector<string>;
+	vector<string> out_buffers(parts.size());
+	vector<uint64_t> out_counts(parts.size());
+
+	while (in.good()) {
 		buffer->clear();
 		buffer->reserve(load_factor);
-		temp_map->clear();
+		for (size_t p = 0; p < out_buffers.size(); ++p) {
+			out_buffers.at(p).clear();
+			out_counts.at(p) = 0;
+		}
 
 		// critical
-		// lock the mutex to read from the R1 stream
-		// and fill in the buffer for processing
+		// lock the mutex and read from the stream to populate the buffer
 		mtx.lock();
 		for (uint32_t i = 0; i < load_factor; ++i) {
-			if (lines_read < max_lines) {
-				if (getline(inR1, line)) {
-					buffer->push_back(line);
-					lines_read++;
-					} else { break; }
-			}
+			if (getline(in, line)) {
+				buffer->push_back(line);
+			} else { break; }
 		}
 		mtx.unlock();
 		// end critical
 
-		// populate the temporary hash
 		for (size_t j = 0; j < buffer->size(); ++j) {
-			chunks = split_string(buffer->at(j), INPUT_SEP);
-			// iterate over the chunks vector and add to the hash
-			for (size_t k = 1; k < chunks.size(); ++k) {
-				(*temp_map)[chunks.at(0)].push_back(chunks.at(k));
+			split_record(buffer->at(j), id, fields);
+			uint64_t key = encode_key(id);
+			size_t p = boost::hash<uint64_t>()(key) % parts.size();
+			put_record(out_buffers.at(p), key, id, fields);
+			out_counts.at(p)++;
+		}
+
+		write_parts(parts, out_buffers, out_counts, counts);
+	}
+	// cleanup
+	delete(buffer);
+}
+
+/* appends buffers to the partitions, each behind its own lock so threads
+ * only wait for each other on the same partition. Partitions that are busy
+ * are skipped on the first pass and waited for on the second
+ * arguments:
+ * 	partition streams
+ * 	buffer per partition
+ * 	records per buffer
+ * 	records per partition (updated)
+ * 	*/
+void Map_merger::write_parts(
+		vector<ofstream*>& parts,
+		vector<string>& bufs,
+		vector<uint64_t>& n_recs,
+		vector<uint64_t>& counts) {
+
+	vector<bool> done(parts.size(), false);
+	for (uint8_t pass = 0; pass < 2; ++pass) {
+		for (size_t p = 0; p < parts.size(); ++p) {
+			if (done.at(p)) { continue; }
+			if (n_recs.at(p) == 0) {
+				done.at(p) = true;
+				continue;
+			}
+
+			// critical
+			if (pass == 0) {
+				if (!part_mtx.at(p)->try_lock()) { continue; }
+			} else { part_mtx.at(p)->lock(); }
+			parts.at(p)->write(bufs.at(p).data(), bufs.at(p).length());
+			counts.at(p) += n_recs.at(p);
+			part_mtx.at(p)->unlock();
+			// end critical
+
+			done.at(p) = true;
+		}
+	}
+}
+
+/* creates the partition files of an input and their locks, the files are
+ * named <tmp dir>/<tag>.<pid>.<partition>
+ * arguments:
+ * 	file name tag
+ * 	partition file names (output)
+ * 	partition streams (output)
+ * 	*/
+void Map_merger::open_parts(const string& tag, vector<string>& fns, vector<ofstream*>& parts) {
+	for (uint16_t p = 0; p < n_parts; ++p) {
+		part_mtx.push_back(new boost::mutex);
+		fns.push_back(tmp_dir + "/" + tag + "." + run_id + "." + to_string(p));
+		add_tmp_file(fns.back());
+		parts.push_back(new ofstream);
+		attach_stream<ofstream>(
+				const_cast<char*>(fns.back().c_str()),
+				*parts.back(),
+				ios_base::out | ios_base::binary);
+	}
+}
+
+/* closes the partition files opened by open_parts
+ * arguments:
+ * 	partition streams
+ * 	*/
+void Map_merger::close_parts(vector<ofstream*>& parts) {
+	for (size_t p = 0; p < parts.size(); ++p) {
+		parts.at(p)->close();
+		delete(parts.at(p));
+		delete(part_mtx.at(p));
+	}
+	parts.clear();
+	part_mtx.clear();
+}
+
+/* joins partition pairs until none are left, the R1 partition is loaded
+ * into a flat table sized from its record count and file size and the R2
+ * partition streamed against it. With unpaired outputs open, R2 records
+ * without a mate are written as they are probed and R1 records left
+ * unmarked in the table by a sweep at the end of the partition.
+ * arguments:
+ * 	R1 partition files
+ * 	R2 partition files
+ * 	output stream
+ * 	boolean zipped output
+ * 	unpaired R1 stream
+ * 	unpaired R2 stream
+ * 	*/
+void Map_merger::join_partitions(
+		vector<string>& fn1,
+		vector<string>& fn2,
+		ofstream& outf,
+		bool z_out,
+		ofstream& u1,
+		ofstream& u2) {
+
+	uint64_t key;
+	string id;
+	string fields;
+	string* out_buffer = new string;
+	string* u1_buffer = new string;
+	string* u2_buffer = new string;
+	size_t slot;
+	const char* f1;
+	uint32_t f1_len;
+	Pair_table* R1_part = new Pair_table;
+	umu64s* R1_hashed = new umu64s;		// IDs of hashed keys
+
+	while (1) {
+		// critical
+		// take the next partition
+		mtx.lock();
+		size_t p = next_part++;
+		mtx.unlock();
+		// end critical
+
+		if (p >= fn1.size()) { break; }
+
+		R1_part->clear();
+		R1_hashed->clear();
+		ifstream in1(fn1.at(p).c_str(), ios_base::in | ios_base::binary | ios_base::ate);
+		// each record stores a key and the fields length besides the fields
+		uint64_t n1 = part_records.at(p);
+		uint64_t b1 = in1.tellg();
+		R1_part->reserve(n1, b1 - n1*(sizeof(uint64_t) + sizeof(uint32_t)));
+		in1.seekg(0);
+		uint64_t n_dup = 0;
+		while (get_record(in1, key, id, fields)) {
+			if (!R1_part->insert(key, fields)) {
+				n_dup++;
+				if (u1.is_open()) { unpaired_record((key & RK_HASHED) ? id : decode_key(key), fields, *u1_buffer); }
+			} else if (key & RK_HASHED) {
+				(*R1_hashed)[key] = id;
 			}
 		}
+		in1.close();
+		if (u1.is_open()) { write_buffer(*u1_buffer, u1, z_unpR1); }
 
 		// critical
-		// lock the mutex to add to the main id hash
+		// keep the largest table for the stats
 		mtx.lock();
-		R1_hash->insert(temp_map->begin(), temp_map->end());;
+		n_dup_R1 += n_dup;
+		if (R1_part->get_bytes() > peak_bytes) {
+			peak_bytes = R1_part->get_bytes();
+			peak_entries = R1_part->size();
+			peak_overhead = R1_part->get_overhead();
+		}
 		mtx.unlock();
 		// end critical
+
+		ifstream in2(fn2.at(p).c_str(), ios_base::in | ios_base::binary);
+		uint32_t n_out = 0;
+		bool more = true;
+		while (more) {
+			more = get_record(in2, key, id, fields);
+			if (more) {
+				bool hashed = key & RK_HASHED;
+				if (R1_part->find(key, slot) && (!hashed || ((*R1_hashed)[key] == id))) {
+					R1_part->get(slot, key, f1, f1_len);
+					R1_part->mark(slot);
+					join_records(hashed ? id : decode_key(key), string(f1, f1_len), fields, *out_buffer);
+					n_out++;
+				} else if (u2.is_open()) {
+					unpaired_record(hashed ? id : decode_key(key), fields, *u2_buffer);
+					n_out++;
+				}
+			}
+
+			if ((n_out < load_factor) && more) { continue; }
+
+			write_buffer(*out_buffer, outf, z_out);
+			if (u2.is_open()) { write_buffer(*u2_buffer, u2, z_unpR2); }
+			n_out = 0;
+		}
+		in2.close();
+
+		// R1 records no R2 record was paired with
+		if (u1.is_open()) {
+			for (size_t s = 0; s < R1_part->get_n_slots(); ++s) {
+				if (!R1_part->used(s) || R1_part->marked(s)) { continue; }
+				R1_part->get(s, key, f1, f1_len);
+				unpaired_record((key & RK_HASHED) ? (*R1_hashed)[key] : decode_key(key), string(f1, f1_len), *u1_buffer);
+				if (++n_out >= load_factor) {
+					write_buffer(*u1_buffer, u1, z_unpR1);
+					n_out = 0;
+				}
+			}
+			write_buffer(*u1_buffer, u1, z_unpR1);
 		}
+
+		remove_tmp_file(fn1.at(p));
+		remove_tmp_file(fn2.at(p));
+	}
 	// cleanup
-	delete(temp_map);
-	delete(buffer);
+	delete(R1_part);
+	delete(R1_hashed);
+	delete(out_buffer);
+	delete(u1_buffer);
+	delete(u2_buffer);
 }
 
-/* merges the id maps
- * takes no argumenst */
-template<class T1> void Map_merger::match_reads(T1& inR2, ofstream& outf, bool z_out) {
+/* writes and empties an output buffer, stdout if the stream is not open
+ * arguments:
+ * 	buffer
+ * 	output stream
+ * 	boolean zipped output
+ * 	*/
+void Map_merger::write_buffer(string& buf, ofstream& outf, bool z_out) {
+	if (z_out) { buf = compress_string(buf); }
+
+	// critical
+	// write the buffer
+	mtx.lock();
+	if (outf.is_open()) { outf << buf; } else { cout << buf; }
+	mtx.unlock();
+	// end critical
+
+	buf.clear();
+}
+
+/* appends an unpaired record as it was read, the id followed by its fields
+ * arguments:
+ * 	read ID
+ * 	fields after the read ID
+ * 	output buffer
+ * 	*/
+void Map_merger::unpaired_record(const string& key, const string& fields, string& out) {
+	out += key;
+	if (!fields.empty()) { out += INPUT_SEP + fields; }
+	out += "\n";
+}
+
+/* appends a paired record, the id followed by the R1 and the R2 fields
+ * arguments:
+ * 	read ID
+ * 	R1 fields
+ * 	R2 fields
+ * 	output buffer
+ * 	*/
+void Map_merger::join_records(const string& key, const string& f1, const string& f2, string& out) {
+	out += key;
+	if (!f1.empty()) {
+		vector<string> c1 = split_string(f1, INPUT_SEP);
+		for (size_t k = 0; k < c1.size(); ++k) { out += OUTPUT_SEP + c1.at(k); }
+	}
+	if (!f2.empty()) {
+		vector<string> c2 = split_string(f2, INPUT_SEP);
+		for (size_t k = 0; k < c2.size(); ++k) { out += OUTPUT_SEP + c2.at(k); }
+	}
+	out += "\n";
+}
+
+/* pairs R1 and R2 records of inputs that keep the read order of the FASTQ
+ * files in a single pass over each. Records dropped on either side and local
+ * reordering (e.g. from threaded extraction) are absorbed by a lookahead of
+ * window R2 records, kept around the R2 position expected for the current
+ * R1 record. Unmatched R2 records falling behind that position and R1
+ * records without a mate within the window are skipped.
+ * arguments:
+ * 	R1 stream
+ * 	R2 stream
+ * 	output stream
+ * 	boolean zipped output
+ * 	*/
+template<class T> void Map_merger::merge_join(T& inR1, T& inR2, ofstream& outf, bool z_out) {
 	string line;
-	vector<string>* in_buffer = new vector<string>;
+	string id, fields;
+	string id2, fields2;
 	string* out_buffer = new string;
 
-	vector<string> chunks;
-	string key;
+	umu64pr* pending = new umu64pr;
+	umu64s* pending_ids = new umu64s;	// IDs of hashed keys
+	dqpu64* order = new dqpu64;
+
+	uint64_t i = 0;		// R1 records read
+	uint64_t j = 0;		// R2 records read
+	int64_t shift = 0;	// R2 minus R1 record number of the last pair
+	uint32_t n_out = 0;
+	bool r2_done = false;
+
+	while (getline(inR1, line)) {
+		split_record(line, id, fields);
+		uint64_t key = encode_key(id);
+		int64_t expected = i + shift;
+
+		// forget R2 records that fell out of the window
+		while (!order->empty() && ((int64_t) order->front().first + window < expected)) {
+			umu64pr_it it = pending->find(order->front().second);
+			if ((it != pending->end()) && (it->second.first == order->front().first)) {
+				pending->erase(it);
+				pending_ids->erase(order->front().second);
+			}
+			order->pop_front();
+		}
 
-	// read from the R2 stream
-	while (inR2.good()) {
-		in_buffer->clear();
-		in_buffer->reserve(load_factor);
+		umu64pr_it it = pending->find(key);
+		if ((it != pending->end()) && (!(key & RK_HASHED) || ((*pending_ids)[key] == id))) {
+			shift = (int64_t) it->second.first - i;
+			join_records(id, fields, it->second.second, *out_buffer);
+			pending->erase(it);
+			pending_ids->erase(key);
+			n_out++;
+		} else {
+			// read ahead in R2 until the mate shows up or the window is used up
+			while (!r2_done && ((int64_t) j < expected + window)) {
+				if (!getline(inR2, line)) {
+					r2_done = true;
+					break;
+				}
+				split_record(line, id2, fields2);
+				uint64_t k2 = encode_key(id2);
+				if ((k2 == key) && (!(key & RK_HASHED) || (id2 == id))) {
+					shift = (int64_t) j - i;
+					join_records(id, fields, fields2, *out_buffer);
+					n_out++;
+					j++;
+					break;
+				}
+				(*pending)[k2] = make_pair(j, fields2);
+				if (k2 & RK_HASHED) { (*pending_ids)[k2] = id2; }
+				order->push_back(make_pair(j, k2));
+				j++;
+			}
+		}
+		i++;
+
+		if (n_out >= load_factor) {
+			if (z_out) { *out_buffer = compress_string(*out_buffer); }
+			if (outf.is_open()) { outf << *out_buffer; } else { cout << *out_buffer; }
+			out_buffer->clear();
+			n_out = 0;
+		}
+	}
+
+	if (z_out) { *out_buffer = compress_string(*out_buffer); }
+	if (outf.is_open()) { outf << *out_buffer; } else { cout << *out_buffer; }
+
+	// cleanup
+	delete(out_buffer);
+	delete(pending);
+	delete(pending_ids);
+	delete(order);
+}
+
+/* loads an input into a table, records are parsed in parallel and added
+ * under the mutex a batch at a time. Records with a key already in the
+ * table are written to the unpaired R1 stream
+ * arguments:
+ * 	input stream
+ * 	table
+ * 	IDs of hashed keys
+ * 	unpaired R1 stream
+ * 	*/
+template<class T> void Map_merger::load_table(T& in, Pair_table* t, umu64s* hashed, ofstream& u1) {
+	string line;
+	string id, fields;
+	vector<string>* buffer = new vector<string>;
+	string* u1_buffer = new string;
+	vector<uint64_t> keys;
+	vector<string> ids;
+	vector<string> f;
+
+	while (in.good()) {
+		buffer->clear();
+		buffer->reserve(load_factor);
 
-		out_buffer->clear();
-		out_buffer->reserve(500*load_factor);
-	
 		// critical
-		// lock the mutex and fill in the in_buffer
+		// read from input and fill buffer
 		mtx.lock();
 		for (uint32_t i = 0; i < load_factor; ++i) {
-			if ( getline(inR2, line ))  { in_buffer->push_back(line); } else { break; }
+			if (getline(in, line)) {
+				buffer->push_back(line);
+			} else { break; }
 		}
 		mtx.unlock();
 		// end critical
-		
-		// iterate over the in_buffer to find matching reads in the main R1 hash
-		for (size_t j = 0; j < in_buffer->size(); ++j) {
-			chunks = split_string(in_buffer->at(j), INPUT_SEP);
-			key = chunks.at(0);
-
-			// check if we have the id already and if so add a new record to the
-			// out buffer
-			if (R1_hash->find(key) != R1_hash->end()) {
-				// start with the key
-				*out_buffer += key;
-				
-				// iterate ove the R1_hash
-				for (size_t k = 0; k < (*R1_hash)[key].size(); ++k) {
-					*out_buffer +=  OUTPUT_SEP + (*R1_hash)[key].at(k);
-				}
 
-				// iterate over the chunks vector
-				for (size_t l = 1; l < chunks.size(); ++l) {
-					*out_buffer += OUTPUT_SEP + chunks.at(l);
-				}
+		keys.resize(buffer->size());
+		ids.resize(buffer->size());
+		f.resize(buffer->size());
+		for (size_t j = 0; j < buffer->size(); ++j) {
+			split_record(buffer->at(j), ids.at(j), f.at(j));
+			keys.at(j) = encode_key(ids.at(j));
+		}
 
-				// add the newline at the end
-				*out_buffer += "\n";
+		// critical
+		// add the batch to the table
+		mtx.lock();
+		for (size_t j = 0; j < keys.size(); ++j) {
+			if (!t->insert(keys.at(j), f.at(j))) {
+				n_dup_R1++;
+				if (u1.is_open()) { *u1_buffer += buffer->at(j) + "\n"; }
+			} else if (keys.at(j) & RK_HASHED) {
+				(*hashed)[keys.at(j)] = ids.at(j);
 			}
 		}
+		mtx.unlock();
+		// end critical
 
-		if (z_out) { *out_buffer = compress_string(*out_buffer); }
+		if (u1.is_open()) { write_buffer(*u1_buffer, u1, z_unpR1); }
+	}
+	// cleanup
+	delete(buffer);
+	delete(u1_buffer);
+}
 
-		// critical
-		// write the out buffer to cout
-		mtx.lock();
+/* streams an input against a loaded R1 table, the table is only read
+ * apart from marking the paired entries
+ * arguments:
+ * 	R2 stream
+ * 	R1 table
+ * 	IDs of hashed keys
+ * 	output stream
+ * 	boolean zipped output
+ * 	unpaired R2 stream
+ * 	*/
+template<class T> void Map_merger::probe_table(
+		T& in,
+		Pair_table* t,
+		umu64s* hashed,
+		ofstream& outf,
+		bool z_out,
+		ofstream& u2) {
 
-		// to file
-		if (outf.is_open()) { outf << *out_buffer; } 
-		
-		// to stdout
-		else { cout << *out_buffer; }
+	string line;
+	string id, fields;
+	vector<string>* buffer = new vector<string>;
+	string* out_buffer = new string;
+	string* u2_buffer = new string;
+	uint64_t key;
+	size_t slot;
+	const char* f1;
+	uint32_t f1_len;
 
+	while (in.good()) {
+		buffer->clear();
+		buffer->reserve(load_factor);
+
+		// critical
+		// read from input and fill buffer
+		mtx.lock();
+		for (uint32_t i = 0; i < load_factor; ++i) {
+			if (getline(in, line)) {
+				buffer->push_back(line);
+			} else { break; }
+		}
 		mtx.unlock();
 		// end critical
+
+		for (size_t j = 0; j < buffer->size(); ++j) {
+			split_record(buffer->at(j), id, fields);
+			key = encode_key(id);
+			bool found = t->find(key, slot);
+			if (found && (key & RK_HASHED)) {
+				umu64s_it it = hashed->find(key);
+				found = (it != hashed->end()) && (it->second == id);
+			}
+
+			if (found) {
+				t->get(slot, key, f1, f1_len);
+				t->mark(slot);
+				join_records(id, string(f1, f1_len), fields, *out_buffer);
+			} else if (u2.is_open()) {
+				*u2_buffer += buffer->at(j) + "\n";
+			}
+		}
+
+		write_buffer(*out_buffer, outf, z_out);
+		if (u2.is_open()) { write_buffer(*u2_buffer, u2, z_unpR2); }
 	}
 	// cleanup
-	delete(in_buffer);
+	delete(buffer);
 	delete(out_buffer);
+	delete(u2_buffer);
+}
+
+/* pairs the inputs with R1 held in one table in memory, no partitions are
+ * written
+ * arguments:
+ * 	R1 stream
+ * 	R2 stream
+ * 	output stream
+ * 	boolean zipped output
+ * 	unpaired R1 stream
+ * 	unpaired R2 stream
+ * 	*/
+template<class T> void Map_merger::join_in_memory(
+		T& in1,
+		T& in2,
+		ofstream& outf,
+		bool z_out,
+		ofstream& u1,
+		ofstream& u2) {
+
+	Pair_table* R1_table = new Pair_table;
+	umu64s* R1_hashed = new umu64s;
+	// the sampled records include the read IDs, so the arena is reserved
+	// generously, pages that are never written take no memory
+	R1_table->reserve(plan_records, plan_records * plan_rec_len);
+
+	boost::thread_group tgroup1;
+	attach_stream<T>(R1fn, in1, ios_base::in);
+	for (uint8_t i = 0; i < n_threads; ++i) {
+		tgroup1.create_thread(boost::bind(
+					&Map_merger::load_table<T>,
+					this,
+					boost::ref(in1),
+					R1_table,
+					R1_hashed,
+					boost::ref(u1)
+					)
+				);
+	}
+	tgroup1.join_all();
+	in1.close();
+	in1.clear();
+
+	peak_bytes = R1_table->get_bytes();
+	peak_entries = R1_table->size();
+	peak_overhead = R1_table->get_overhead();
+
+	boost::thread_group tgroup2;
+	attach_stream<T>(R2fn, in2, ios_base::in);
+	for (uint8_t i = 0; i < n_threads; ++i) {
+		tgroup2.create_thread(boost::bind(
+					&Map_merger::probe_table<T>,
+					this,
+					boost::ref(in2),
+					R1_table,
+					R1_hashed,
+					boost::ref(outf),
+					z_out,
+					boost::ref(u2)
+					)
+				);
+	}
+	tgroup2.join_all();
+	in2.close();
+	in2.clear();
+
+	// R1 records no R2 record was paired with
+	if (u1.is_open()) {
+		string* u1_buffer = new string;
+		uint64_t key;
+		const char* f1;
+		uint32_t f1_len;
+		uint32_t n_out = 0;
+		for (size_t s = 0; s < R1_table->get_n_slots(); ++s) {
+			if (!R1_table->used(s) || R1_table->marked(s)) { continue; }
+			R1_table->get(s, key, f1, f1_len);
+			unpaired_record((key & RK_HASHED) ? (*R1_hashed)[key] : decode_key(key), string(f1, f1_len), *u1_buffer);
+			if (++n_out >= load_factor) {
+				write_buffer(*u1_buffer, u1, z_unpR1);
+				n_out = 0;
+			}
+		}
+		write_buffer(*u1_buffer, u1, z_unpR1);
+		delete(u1_buffer);
+	}
+
+	// cleanup
+	delete(R1_table);
+	delete(R1_hashed);
+}
+
+/* picks the join for the inputs from the estimated R1 size and the
+ * available memory (or the budget set with set_memory). R1 held in memory
+ * costs about a record plus the table overhead (MM_RECORD_OVERHEAD) per
+ * record. If that fits in MM_MEMORY_SHARE of the memory R1 is joined in
+ * memory, otherwise partitioned into enough parts for every thread to hold
+ * one. Without a budget (the memory is unknown, or the cgroup limit is
+ * used up) R1 is never held in memory: it is split into MM_DEFAULT_PARTS
+ * partitions, or MM_MAX_PARTS if the cgroup has no memory left
+ * arguments:
+ * 	boolean zipped input
+ * 	*/
+void Map_merger::plan_join(bool z_in) {
+	if (z_in) {
+		plan_records = estimate_records<igzstream>(R1fn, z_in, plan_rec_len);
+	} else {
+		plan_records = estimate_records<ifstream>(R1fn, z_in, plan_rec_len);
+	}
+	bool exhausted = false;
+	if (!memory_budget) { memory_budget = available_memory(&exhausted) * MM_MEMORY_SHARE; }
+
+	uint64_t table = plan_records * (plan_rec_len + MM_RECORD_OVERHEAD);
+	// read and output buffers of the threads
+	uint64_t buffers = (uint64_t) n_threads * load_factor * plan_rec_len * 4;
+
+	plan_note.clear();
+	if (!memory_budget) {
+		plan = MM_PLAN_PARTITIONED;
+		if (exhausted) {
+			plan_note = "cgroup memory limit reached, most partitions";
+			n_parts = MM_MAX_PARTS;
+		} else {
+			plan_note = "available memory unknown, default partitions";
+			n_parts = MM_DEFAULT_PARTS;
+		}
+		plan_memory = (table / n_parts) * min((uint64_t) n_threads, (uint64_t) n_parts) + buffers;
+		return;
+	}
+
+	if (table + buffers <= memory_budget) {
+		plan = MM_PLAN_MEMORY;
+		plan_memory = table + buffers;
+		return;
+	}
+
+	plan = MM_PLAN_PARTITIONED;
+	uint64_t per_thread = (memory_budget > buffers) ? (memory_budget - buffers) / n_threads : 1;
+	uint64_t p = table / (per_thread ? per_thread : 1) + 1;
+	if (p > MM_MAX_PARTS) { p = MM_MAX_PARTS; }
+	n_parts = p;
+	plan_memory = (table / n_parts) * min((uint64_t) n_threads, (uint64_t) n_parts) + buffers;
 }
 
+/* setter for the memory budget of plan_join in bytes, 0 uses the memory
+ * available */
+void Map_merger::set_memory(uint64_t m) { memory_budget = m; }
+
+/* bytes plan_join predicts the join to use, 0 if not planned */
+uint64_t Map_merger::get_plan_memory() const { return plan_memory; }
+
 /* a public member threaded wrapper function to match
  * R1 and R2 Ids. Call this from app */
 void Map_merger::merge_id_maps(bool z_in, bool z_out) {
@@ -282,148 +1092,234 @@ void Map_merger::merge_id_maps(bool z_in, bool z_out) {
 	// open file if one is given
 	if (outfile) { attach_stream<ofstream>(outfile, o, ios_base::out | ios_base::binary); }
 
-	// input and output unzipped
-	if (!z_in) {
+	learn_key_prefix(z_in);
+
+	// order preserving inputs are merged in one pass
+	if (window && !z_in) {
 		attach_stream<ifstream>(R1fn, i1, ios_base::in);
 		attach_stream<ifstream>(R2fn, i2, ios_base::in);
-
-		// read from R1
-		while (i1.good()) {
-			// reset line counter
-			lines_read = 0;
-		
-			// setup threads
-			boost::thread_group tgroup1;
-			for (uint8_t i = 0; i < n_threads; ++i) {
-				tgroup1.create_thread(boost::bind(
-							&Map_merger::read_id_map<ifstream>, 
-							this,
-							boost::ref(i1)
-							)
-						);
-			}
-			tgroup1.join_all();
-		
-			// reset the R2 stream - for each iteration of the loop we iterate over the entire
-			// R2 stream to try to find matches
-			i2.clear();
-			i2.seekg(0, ios::beg);
-	
-			// setup threads
-			boost::thread_group tgroup2;
-			for (uint8_t i = 0; i < n_threads; ++i) {
-				tgroup2.create_thread(boost::bind(
-							&Map_merger::match_reads<ifstream>, 
-							this,
-							boost::ref(i2),
-							boost::ref(o),
-							z_out
-							)
-						);
-			}
-			tgroup2.join_all();
-
-			// empty the main R1 hash to be rady for the next iteration
-			R1_hash->clear();
-			}
+		merge_join<ifstream>(i1, i2, o, z_out);
 		i1.close();
 		i2.close();
 	}
 
-	// input zipped
-	if (z_in) {
-		attach_stream<igzstream>(R1fn, z1, ios_base::in);
-	
-		// read from R1
-		while (z1.good()) {
-			// reset line counter
-			lines_read = 0;
-		
-			// setup threads
-			boost::thread_group tgroup1;
+	if (window && z_in) {
+		attach_stream<igzstream>(R1fn, z1, ios_base::in);
+		attach_stream<igzstream>(R2fn, z2, ios_base::in);
+		merge_join<igzstream>(z1, z2, o, z_out);
+		z1.close();
+		z2.close();
+	}
+
+	if (window) {
+		if (o.is_open()) { o.close(); }
+		return;
+	}
+
+	// unpaired outputs, written by the in-memory and the partitioned join
+	ofstream u1, u2;
+	if (unpR1) { attach_stream<ofstream>(unpR1, u1, ios_base::out | ios_base::binary); }
+	if (unpR2) { attach_stream<ofstream>(unpR2, u2, ios_base::out | ios_base::binary); }
+
+	if (plan == MM_PLAN_MEMORY) {
+		if (z_in) {
+			join_in_memory<igzstream>(z1, z2, o, z_out, u1, u2);
+		} else {
+			join_in_memory<ifstream>(i1, i2, o, z_out, u1, u2);
+		}
+		if (o.is_open()) { o.close(); }
+		if (u1.is_open()) { u1.close(); }
+		if (u2.is_open()) { u2.close(); }
+		return;
+	}
+
+	// partition both inputs by read ID hash, R1 first then R2
+	vector<string> fn1, fn2;
+	for (uint8_t r = 0; r < 2; ++r) {
+		char* fn = r ? R2fn : R1fn;
+		vector<string>& fns = r ? fn2 : fn1;
+
+		vector<ofstream*> parts;
+		vector<uint64_t> counts(n_parts, 0);
+		open_parts("R1R2.r" + to_string(r + 1), fns, parts);
+
+		boost::thread_group tgroup1;
+		if (!z_in) {
+			attach_stream<ifstream>(fn, i1, ios_base::in);
 			for (uint8_t i = 0; i < n_threads; ++i) {
 				tgroup1.create_thread(boost::bind(
-							&Map_merger::read_id_map<igzstream>, 
+							&Map_merger::partition<ifstream>,
 							this,
-							boost::ref(z1)
+							boost::ref(i1),
+							boost::ref(parts),
+							boost::ref(counts)
 							)
 						);
 			}
 			tgroup1.join_all();
-		
-			// reopen the R2 stream - for each iteration of the loop we iterate over the entire
-			// R2 stream to try to find matches
-			attach_stream<igzstream>(R2fn, z2, ios_base::in);
-			
-			// setup threads
-			boost::thread_group tgroup2;
+			i1.close();
+			i1.clear();
+		} else {
+			attach_stream<igzstream>(fn, z1, ios_base::in);
 			for (uint8_t i = 0; i < n_threads; ++i) {
-				tgroup2.create_thread(boost::bind(
-							&Map_merger::match_reads<igzstream>, 
+				tgroup1.create_thread(boost::bind(
+							&Map_merger::partition<igzstream>,
 							this,
-							boost::ref(z2),
-							boost::ref(o),
-							z_out
+							boost::ref(z1),
+							boost::ref(parts),
+							boost::ref(counts)
 							)
 						);
 			}
-			tgroup2.join_all();
-			z2.close();
-			z2.clear();
+			tgroup1.join_all();
+			z1.close();
+			z1.clear();
+		}
 
-			// empty the main R1 hash to be rady for the next iteration
-			R1_hash->clear();
-			}
-		z1.close();
-		z2.close();
+		close_parts(parts);
+		if (r == 0) { part_records = counts; }
+	}
+
+	// join the partition pairs in parallel
+	next_part = 0;
+	boost::thread_group tgroup2;
+	for (uint8_t i = 0; i < n_threads; ++i) {
+		tgroup2.create_thread(boost::bind(
+					&Map_merger::join_partitions,
+					this,
+					boost::ref(fn1),
+					boost::ref(fn2),
+					boost::ref(o),
+					z_out,
+					boost::ref(u1),
+					boost::ref(u2)
+					)
+				);
 	}
+	tgroup2.join_all();
 
 	// close files
 	if (o.is_open()) { o.close(); }
+	if (u1.is_open()) { u1.close(); }
+	if (u2.is_open()) { u2.close(); }
+}
+
+/* reads a batch of up to load_factor lines of an input under the mutex and
+ * then works out their keys. During a pass with a cache the lines are also
+ * written to it along with their keys
+ * arguments:
+ * 	input stream
+ * 	lines (output)
+ * 	keys of the lines (output)
+ * 	*/
+template<class T> void Map_merger::read_batch(T& in, vector<string>& lines, vector<uint64_t>& keys) {
+	string line;
+	string id, fields;
+
+	lines.clear();
+	lines.reserve(load_factor);
+
+	// critical
+	// lock the mutex and read from the stream to populate the buffer
+	mtx.lock();
+	for (uint32_t i = 0; i < load_factor; ++i) {
+		if (getline(in, line)) {
+			lines.push_back(line);
+		} else { break; }
+	}
+	mtx.unlock();
+	// end critical
+
+	keys.resize(lines.size());
+	for (size_t j = 0; j < lines.size(); ++j) {
+		split_record(lines.at(j), id, fields);
+		keys.at(j) = encode_key(id);
+	}
+
+	if (cache_out) {
+		string buf;
+		for (size_t j = 0; j < lines.size(); ++j) {
+			uint32_t len = lines.at(j).length();
+			buf.append(reinterpret_cast<const char*>(&keys.at(j)), sizeof(uint64_t));
+			buf.append(reinterpret_cast<const char*>(&len), sizeof(len));
+			buf += lines.at(j);
+		}
+		write_cache(buf);
+	}
+}
+
+/* reads a batch of lines and their keys from an input cache, nothing is
+ * parsed
+ * arguments:
+ * 	cache stream
+ * 	lines (output)
+ * 	keys of the lines (output)
+ * 	*/
+void Map_merger::read_batch(Cache_stream& in, vector<string>& lines, vector<uint64_t>& keys) {
+	uint64_t key;
+	string line;
+
+	lines.clear();
+	keys.clear();
+
+	// critical
+	mtx.lock();
+	for (uint32_t i = 0; i < load_factor; ++i) {
+		if (in.next(key, line)) {
+			lines.push_back(line);
+			keys.push_back(key);
+		} else { break; }
+	}
+	mtx.unlock();
+	// end critical
 }
 
 /* extracts the IDs form a mapping file
  * arguments:
  * 	input filestream
  * 	set to store the results
+ * 	IDs seen again (output)
  * 	*/
-template<class T> void Map_merger::get_ids(T& in, uss& s) {
-	string line;
+template<class T> void Map_merger::get_ids(T& in, READ_SET& s, READ_LIST& dups) {
 	vector<string>* buffer = new vector<string>;
+	vector<uint64_t> keys;
+	READ_LIST temp_dups;
+	string id, fields;
 
 	// temporary set
-	uss* temp_set = new uss;
-
-	vector<string> chunks;
+	READ_SET* temp_set = new READ_SET;
 	
 	// check if stream is ok
 	while (in.good()){
-		buffer->clear();
-		buffer->reserve(load_factor);
-
-		temp_set->clear();
-
-		// critical
-		// lock the mutex and read from the stream to populate the buffer
-		mtx.lock();
-		for (uint32_t i = 0; i < load_factor; ++i) {
-			if (getline(in, line)) {
-				buffer->push_back(line);
-			} else { break; }
-		}
-		mtx.unlock();
-		// end critical
-
-		// iterate over the buffer and extract the IDs and populate the temporary set
-		for (size_t j = 0; j < buffer->size(); ++j) {
-			chunks = split_string(buffer->at(j), INPUT_SEP);
-			temp_set->insert(chunks.at(0));
+		temp_set->keys.clear();
+		temp_set->ids.clear();
+		temp_dups.keys.clear();
+		temp_dups.ids.clear();
+
+		read_batch(in, *buffer, keys);
+
+		// populate the temporary set with the IDs of the buffer, the ID
+		// itself for hashed keys
+		for (size_t j = 0; j < keys.size(); ++j) {
+			if (keys.at(j) & RK_HASHED) {
+				split_record(buffer->at(j), id, fields);
+				if (!temp_set->ids.insert(id).second) { temp_dups.ids.push_back(id); }
+			} else if (!temp_set->keys.insert(keys.at(j)).second) {
+				temp_dups.keys.push_back(keys.at(j));
+			}
 		}
 
 		// critical
 		// insert temporary set into main set
 		mtx.lock();
-		s.insert(temp_set->begin(), temp_set->end());
+		for (usu64_it it = temp_set->keys.begin(); it != temp_set->keys.end(); ++it) {
+			if (!s.keys.insert(*it).second) { dups.keys.push_back(*it); }
+		}
+		for (uss_it it = temp_set->ids.begin(); it != temp_set->ids.end(); ++it) {
+			if (!s.ids.insert(*it).second) { dups.ids.push_back(*it); }
+		}
+		dups.keys.insert(dups.keys.end(), temp_dups.keys.begin(), temp_dups.keys.end());
+		dups.ids.insert(dups.ids.end(), temp_dups.ids.begin(), temp_dups.ids.end());
 		mtx.unlock();
 		// end critical
 		}
@@ -440,38 +1336,23 @@ template<class T> void Map_merger::get_ids(T& in, uss& s) {
  * 	output stream
  * 	boolen zipped output
  * 	*/
-template<class T1> void Map_merger::extract_reads(T1& in, uss& s, ofstream& out, bool z_out) {
-	string line;
-	vector<string> chunks;
+template<class T1> void Map_merger::extract_reads(T1& in, READ_SET& s, ofstream& out, bool z_out) {
 	vector<string>* in_buffer = new vector<string>;
+	vector<uint64_t> keys;
 	string* out_buffer = new string;
 
 
 	// check if stream is good
 	while (in.good()) {
-		in_buffer->clear();
-		in_buffer->reserve(load_factor);
-
 		out_buffer->clear();
 		out_buffer->reserve(500*load_factor);
 
-		// critical
-		// read from input and fill buffer
-		mtx.lock();
-		for (uint32_t i = 0; i < load_factor; ++i) {
-			if (getline(in, line)) {
-				in_buffer->push_back(line);
-			} else { break; }
-		}
-		mtx.unlock();
-		// end critical
+		read_batch(in, *in_buffer, keys);
 		
-		// extract ID and check if it is in the set
+		// check if the ID is in the set
 		// if yes write the record to the output
 		for (size_t j = 0; j < in_buffer->size(); ++j) {
-			chunks = split_string(in_buffer->at(j), INPUT_SEP);
-			
-			if (s.find(chunks.at(0)) != s.end()) {
+			if (in_set(s, keys.at(j), in_buffer->at(j))) {
 				*out_buffer += in_buffer->at(j) + "\n";
 			}
 		}
@@ -500,13 +1381,520 @@ template<class T1> void Map_merger::extract_reads(T1& in, uss& s, ofstream& out,
  * 	s1 and s2 are sets to be diff'd
  * 	r is the resulting set
  * 	*/
-void Map_merger::set_diff(uss& s1, uss& s2, uss& r) {
-//	for (boost::unordered_set<string>::const_iterator it = s1.begin(); it != s1.end(); ++it) {
-	for (uss_it it = s1.begin(); it != s1.end(); ++it) {
-		if (s2.find(*it) == s1.end()) {
-			r.insert(*it);
+void Map_merger::set_diff(READ_SET& s1, READ_SET& s2, READ_SET& r) {
+	for (usu64_it it = s1.keys.begin(); it != s1.keys.end(); ++it) {
+		if (s2.keys.find(*it) == s2.keys.end()) {
+			r.keys.insert(*it);
+		}
+	}
+	for (uss_it it = s1.ids.begin(); it != s1.ids.end(); ++it) {
+		if (s2.ids.find(*it) == s2.ids.end()) {
+			r.ids.insert(*it);
+		}
+	}
+}
+
+/* number of records with an ID of a set
+ * arguments:
+ * 	set of IDs
+ * 	repeated occurrences of IDs
+ * 	*/
+uint64_t Map_merger::count_records(const READ_SET& s, const READ_LIST& dups) const {
+	uint64_t n = s.keys.size() + s.ids.size();
+	for (size_t i = 0; i < dups.keys.size(); ++i) {
+		if (s.keys.find(dups.keys.at(i)) != s.keys.end()) { n++; }
+	}
+	for (size_t i = 0; i < dups.ids.size(); ++i) {
+		if (s.ids.find(dups.ids.at(i)) != s.ids.end()) { n++; }
+	}
+	return n;
+}
+
+/* whether the ID of a record is in a set, by its ID for hashed keys
+ * arguments:
+ * 	set of IDs
+ * 	key of the record
+ * 	record
+ * 	*/
+bool Map_merger::in_set(const READ_SET& s, uint64_t key, const string& line) const {
+	if (!(key & RK_HASHED)) { return s.keys.find(key) != s.keys.end(); }
+	if (s.ids.empty()) { return false; }
+	return s.ids.find(line.substr(0, line.find(INPUT_SEP))) != s.ids.end();
+}
+
+/* estimates the number of records of an input from its size and the
+ * length of its first lines, compressed inputs are taken to inflate
+ * MM_GZ_RATIO fold
+ * arguments:
+ * 	filename
+ * 	boolean zipped input
+ * 	average record length (output)
+ * 	*/
+template<class T> uint64_t Map_merger::estimate_records(char* fn, bool z_in, uint64_t& rec_len) {
+	ifstream f(fn, ios_base::in | ios_base::binary | ios_base::ate);
+	uint64_t size = f.tellg();
+	f.close();
+	if (z_in) { size *= MM_GZ_RATIO; }
+
+	string line;
+	uint64_t n = 0;
+	uint64_t len = 0;
+	T in;
+	attach_stream<T>(fn, in, ios_base::in);
+	while ((n < 1000) && getline(in, line)) {
+		len += line.length() + 1;
+		n++;
+	}
+	in.close();
+
+	rec_len = n ? len / n : 0;
+	if (n == 0) { return 1; }
+	return (size * n) / len + 1;
+}
+
+/* adds the keys of an input to a Bloom filter
+ * arguments:
+ * 	input stream
+ * 	Bloom filter
+ * 	*/
+template<class T> void Map_merger::bloom_build(T& in, Bloom_filter* b) {
+	vector<string>* buffer = new vector<string>;
+	vector<uint64_t> keys;
+
+	while (in.good()) {
+		read_batch(in, *buffer, keys);
+		for (size_t j = 0; j < keys.size(); ++j) { b->insert(keys.at(j)); }
+	}
+	// cleanup
+	delete(buffer);
+}
+
+/* writes the records of an input whose key is not in a Bloom filter of the
+ * other input, they certainly have no mate. The keys of the others are
+ * written to the partitions as candidates, followed by the read ID (length,
+ * ID) for hashed keys, and optionally added to a second filter
+ * arguments:
+ * 	input stream
+ * 	Bloom filter of the other input
+ * 	Bloom filter of the candidates or NULL
+ * 	partition streams
+ * 	output stream of the unpaired records
+ * 	number of unpaired records (updated)
+ * 	*/
+template<class T> void Map_merger::bloom_split(
+		T& in,
+		Bloom_filter* check,
+		Bloom_filter* add,
+		vector<ofstream*>& parts,
+		ofstream& out,
+		uint64_t& n_unp) {
+
+	vector<string>* buffer = new vector<string>;
+	vector<uint64_t> keys;
+	string id, fields;
+	string* out_buffer = new string;
+	vector<string> part_buffers(parts.size());
+	vector<uint64_t> part_counts(parts.size());
+	vector<uint64_t> counts(parts.size());
+
+	while (in.good()) {
+		for (size_t p = 0; p < parts.size(); ++p) {
+			part_buffers.at(p).clear();
+			part_counts.at(p) = 0;
+		}
+
+		read_batch(in, *buffer, keys);
+
+		uint64_t n = 0;
+		for (size_t j = 0; j < buffer->size(); ++j) {
+			uint64_t key = keys.at(j);
+			if (!check->contains(key)) {
+				if (!count_only) { *out_buffer += buffer->at(j) + "\n"; }
+				n++;
+				continue;
+			}
+			if (add) { add->insert(key); }
+			size_t p = boost::hash<uint64_t>()(key) % parts.size();
+			part_buffers.at(p).append(reinterpret_cast<const char*>(&key), sizeof(key));
+			if (key & RK_HASHED) {
+				split_record(buffer->at(j), id, fields);
+				uint32_t il = id.length();
+				part_buffers.at(p).append(reinterpret_cast<const char*>(&il), sizeof(il));
+				part_buffers.at(p) += id;
+			}
+			part_counts.at(p)++;
+		}
+
+		write_parts(parts, part_buffers, part_counts, counts);
+		if (!count_only) { write_buffer(*out_buffer, out, true); }
+
+		// critical
+		mtx.lock();
+		n_unp += n;
+		mtx.unlock();
+		// end critical
+	}
+	// cleanup
+	delete(buffer);
+	delete(out_buffer);
+}
+
+/* reads the keys of a candidate partition and sorts them, hashed keys
+ * are replaced by their read IDs
+ * arguments:
+ * 	partition file
+ * 	packed keys (output)
+ * 	read IDs of the hashed keys (output)
+ * 	*/
+static void load_keys(const string& fn, vector<uint64_t>& keys, vector<string>& ids) {
+	ifstream in(fn.c_str(), ios_base::in | ios_base::binary);
+	uint64_t key;
+	uint32_t il;
+	string id;
+
+	keys.clear();
+	ids.clear();
+	while (in.read(reinterpret_cast<char*>(&key), sizeof(key))) {
+		if (!(key & RK_HASHED)) {
+			keys.push_back(key);
+			continue;
+		}
+		in.read(reinterpret_cast<char*>(&il), sizeof(il));
+		id.resize(il);
+		in.read(&id[0], il);
+		ids.push_back(id);
+	}
+	in.close();
+	sort(keys.begin(), keys.end());
+	sort(ids.begin(), ids.end());
+}
+
+/* splits two sorted lists into the entries found in one of them only,
+ * repeated entries are kept
+ * arguments:
+ * 	sorted lists
+ * 	entries of each list missing from the other (output)
+ * 	*/
+template<class T> static void sorted_diff(
+		const vector<T>& k1,
+		const vector<T>& k2,
+		vector<T>& u1,
+		vector<T>& u2) {
+
+	u1.clear();
+	u2.clear();
+	size_t i = 0, j = 0;
+	while ((i < k1.size()) || (j < k2.size())) {
+		if ((j == k2.size()) || ((i < k1.size()) && (k1[i] < k2[j]))) {
+			u1.push_back(k1[i++]);
+		} else if ((i == k1.size()) || (k2[j] < k1[i])) {
+			u2.push_back(k2[j++]);
+		} else {
+			T k = k1[i];
+			while ((i < k1.size()) && (k1[i] == k)) { i++; }
+			while ((j < k2.size()) && (k2[j] == k)) { j++; }
+		}
+	}
+}
+
+/* compares the candidate keys of both inputs partition by partition, keys
+ * (read IDs for hashed keys) found on one side only go to the unpaired sets
+ * arguments:
+ * 	R1 candidate partitions
+ * 	R2 candidate partitions
+ * 	*/
+void Map_merger::bloom_verify(vector<string>& fn1, vector<string>& fn2) {
+	vector<uint64_t> k1, k2;
+	vector<uint64_t> u1, u2;
+	vector<string> i1, i2;
+	vector<string> v1, v2;
+
+	while (1) {
+		// critical
+		// take the next partition
+		mtx.lock();
+		size_t p = next_part++;
+		mtx.unlock();
+		// end critical
+
+		if (p >= fn1.size()) { break; }
+
+		load_keys(fn1.at(p), k1, i1);
+		load_keys(fn2.at(p), k2, i2);
+		remove_tmp_file(fn1.at(p));
+		remove_tmp_file(fn2.at(p));
+
+		// hashed keys are compared by their read IDs
+		sorted_diff<uint64_t>(k1, k2, u1, u2);
+		sorted_diff<string>(i1, i2, v1, v2);
+
+		// critical
+		mtx.lock();
+		unpaired_R1->keys.insert(u1.begin(), u1.end());
+		unpaired_R2->keys.insert(u2.begin(), u2.end());
+		unpaired_R1->ids.insert(v1.begin(), v1.end());
+		unpaired_R2->ids.insert(v2.begin(), v2.end());
+		n_unpaired_R1 += u1.size() + v1.size();
+		n_unpaired_R2 += u2.size() + v2.size();
+		mtx.unlock();
+		// end critical
+	}
+}
+
+/* runs extract_reads on an input with all threads
+ * arguments:
+ * 	input stream
+ * 	filename
+ * 	IDs to extract
+ * 	output stream
+ * 	*/
+template<class T> void Map_merger::extract_pass(T& in, char* fn, READ_SET& s, ofstream& out) {
+	boost::thread_group tgroup;
+	attach_stream<T>(fn, in, ios_base::in);
+	for (uint8_t i = 0; i < n_threads; ++i) {
+		tgroup.create_thread(boost::bind(
+					&Map_merger::extract_reads<T>,
+					this,
+					boost::ref(in),
+					boost::ref(s),
+					boost::ref(out),
+					true
+					)
+				);
+	}
+	tgroup.join_all();
+	in.close();
+	in.clear();
+}
+
+/* runs bloom_split on an input with all threads
+ * arguments:
+ * 	input stream
+ * 	filename
+ * 	as bloom_split
+ * 	*/
+template<class T> void Map_merger::split_pass(
+		T& in,
+		char* fn,
+		Bloom_filter* check,
+		Bloom_filter* add,
+		vector<ofstream*>& parts,
+		ofstream& out,
+		uint64_t& n_unp) {
+
+	boost::thread_group tgroup;
+	attach_stream<T>(fn, in, ios_base::in);
+	for (uint8_t i = 0; i < n_threads; ++i) {
+		tgroup.create_thread(boost::bind(
+					&Map_merger::bloom_split<T>,
+					this,
+					boost::ref(in),
+					check,
+					add,
+					boost::ref(parts),
+					boost::ref(out),
+					boost::ref(n_unp)
+					)
+				);
+	}
+	tgroup.join_all();
+	in.close();
+	in.clear();
+}
+
+/* extracts unpaired reads with Bloom filters instead of the sets of all
+ * keys. A filter of the R1 keys sorts out the R2 records that certainly
+ * have no mate, the others are candidates that make up a filter of their
+ * own against which the R1 records are checked. Candidate keys of both
+ * inputs are compared exactly partition by partition on disk and the few
+ * unpaired candidates (false positives of the filters) extracted with a
+ * last pass. The result is the same as with the sets. Compressed inputs
+ * are inflated once, later passes read their caches.
+ * arguments:
+ * 	R1 stream
+ * 	R2 stream
+ * 	boolean zipped input
+ * 	*/
+template<class T> void Map_merger::get_unpaired_bloom(T& in1, T& in2, bool z_in) {
+	ofstream o1;
+	ofstream o2;
+	vector<string> fn1, fn2;
+	vector<ofstream*> parts;
+	Cache_stream c1, c2;
+
+	if (!count_only && unpR1) { attach_stream<ofstream>(unpR1, o1, ios_base::out | ios_base::binary); }
+	if (!count_only && unpR2) { attach_stream<ofstream>(unpR2, o2, ios_base::out | ios_base::binary); }
+
+	// filter of the R1 keys
+	uint64_t rec_len;
+	Bloom_filter* b1 = new Bloom_filter(estimate_records<T>(R1fn, z_in, rec_len), bloom_bits);
+	if (z_in) { start_cache(0); }
+	boost::thread_group tgroup1;
+	attach_stream<T>(R1fn, in1, ios_base::in);
+	for (uint8_t i = 0; i < n_threads; ++i) {
+		tgroup1.create_thread(boost::bind(
+					&Map_merger::bloom_build<T>,
+					this,
+					boost::ref(in1),
+					b1
+					)
+				);
+	}
+	tgroup1.join_all();
+	in1.close();
+	in1.clear();
+	end_cache(0);
+
+	// R2 records missing from the R1 filter are unpaired, the others are
+	// candidates
+	Bloom_filter* b2 = new Bloom_filter(estimate_records<T>(R2fn, z_in, rec_len), bloom_bits);
+	bloom_bytes = b1->get_bytes() + b2->get_bytes();
+	open_parts("UNP.r2", fn2, parts);
+	if (z_in) { start_cache(1); }
+	split_pass<T>(in2, R2fn, b1, b2, parts, o2, n_unpaired_R2);
+	end_cache(1);
+	close_parts(parts);
+	delete(b1);
+
+	// R1 records missing from the candidate filter are unpaired
+	open_parts("UNP.r1", fn1, parts);
+	if (cached[0]) {
+		split_pass<Cache_stream>(c1, const_cast<char*>(cache_fn[0].c_str()), b2, NULL, parts, o1, n_unpaired_R1);
+	} else { split_pass<T>(in1, R1fn, b2, NULL, parts, o1, n_unpaired_R1); }
+	close_parts(parts);
+	delete(b2);
+
+	// exact comparison of the candidates
+	next_part = 0;
+	boost::thread_group tgroup4;
+	for (uint8_t i = 0; i < n_threads; ++i) {
+		tgroup4.create_thread(boost::bind(
+					&Map_merger::bloom_verify,
+					this,
+					boost::ref(fn1),
+					boost::ref(fn2)
+					)
+				);
+	}
+	tgroup4.join_all();
+
+	// extract the unpaired candidates, usually none
+	if (!count_only && !(unpaired_R1->keys.empty() && unpaired_R1->ids.empty())) {
+		if (cached[0]) {
+			extract_pass<Cache_stream>(c1, const_cast<char*>(cache_fn[0].c_str()), *unpaired_R1, o1);
+		} else { extract_pass<T>(in1, R1fn, *unpaired_R1, o1); }
+	}
+
+	if (!count_only && !(unpaired_R2->keys.empty() && unpaired_R2->ids.empty())) {
+		if (cached[1]) {
+			extract_pass<Cache_stream>(c2, const_cast<char*>(cache_fn[1].c_str()), *unpaired_R2, o2);
+		} else { extract_pass<T>(in2, R2fn, *unpaired_R2, o2); }
+	}
+	remove_caches();
+
+	if (count_only) { print_counts(); }
+	if (o1.is_open()) { o1.close(); }
+	if (o2.is_open()) { o2.close(); }
+}
+
+/* starts keeping the records of the pass over an input in a cache file
+ * under the temp directory, given a size limit
+ * arguments:
+ * 	input number (0 R1, 1 R2)
+ * 	*/
+void Map_merger::start_cache(uint8_t r) {
+	cached[r] = false;
+	if (!cache_limit) { return; }
+
+	cache_fn[r] = tmp_dir + "/CACHE.r" + to_string(r + 1) + "." + run_id;
+	add_tmp_file(cache_fn[r]);
+	cache_out = new ofstream;
+	attach_stream<ofstream>(const_cast<char*>(cache_fn[r].c_str()), *cache_out, ios_base::out | ios_base::binary);
+	cache_size = 0;
+	cache_full = false;
+}
+
+/* closes the cache of a pass, a cache that outgrew the limit is dropped
+ * arguments:
+ * 	input number (0 R1, 1 R2)
+ * 	*/
+void Map_merger::end_cache(uint8_t r) {
+	if (!cache_out) { return; }
+	cache_out->close();
+	delete(cache_out);
+	cache_out = NULL;
+
+	cached[r] = !cache_full;
+	if (cache_full) { remove_tmp_file(cache_fn[r]); }
+}
+
+/* appends records (key, line length, line) to the cache of the current
+ * pass if it stays within the limit
+ * arguments:
+ * 	records
+ * 	*/
+void Map_merger::write_cache(const string& buf) {
+	// critical
+	mtx.lock();
+	if (cache_out && !cache_full) {
+		if (cache_size + buf.length() > cache_limit) {
+			cache_full = true;
+		} else {
+			cache_out->write(buf.data(), buf.length());
+			cache_size += buf.length();
 		}
 	}
+	mtx.unlock();
+	// end critical
+}
+
+void Map_merger::remove_caches() {
+	for (uint8_t r = 0; r < 2; ++r) {
+		if (cached[r]) { remove_tmp_file(cache_fn[r]); }
+		cached[r] = false;
+	}
+}
+
+/* setter for the size limit of the input caches in bytes, 0 turns them off */
+void Map_merger::set_cache_limit(uint64_t b) { cache_limit = b; }
+
+/* opens a cache file written by Map_merger::write_cache
+ * arguments:
+ * 	filename
+ * 	open mode, binary is added
+ * 	*/
+void Cache_stream::open(const char* fn, ios_base::openmode mode) {
+	in.open(fn, mode | ios_base::binary);
+}
+
+bool Cache_stream::good() const { return in.good(); }
+
+void Cache_stream::close() { in.close(); }
+
+void Cache_stream::clear() { in.clear(); }
+
+/* reads the next record
+ * returns false at the end of the cache
+ * arguments:
+ * 	key (output)
+ * 	line (output)
+ * 	*/
+bool Cache_stream::next(uint64_t& key, string& line) {
+	uint32_t len;
+	if (!in.read(reinterpret_cast<char*>(&key), sizeof(key))) { return false; }
+	in.read(reinterpret_cast<char*>(&len), sizeof(len));
+	line.resize(len);
+	if (len) { in.read(&line[0], len); }
+	return in.good();
+}
+
+/* prints the number of unpaired records
+ * takes no arguments
+ * */
+void Map_merger::print_counts() {
+	cout << "unpaired R1:\t" << n_unpaired_R1 << endl;
+	cout << "unpaired R2:\t" << n_unpaired_R2 << endl;
+	if (bloom_bits) { cout << "Bloom filters:\t" << bloom_bytes << " bytes" << endl; }
 }
 
 /* extracts unpaired reads from an experiment
@@ -521,6 +1909,22 @@ void Map_merger::get_unpaired_reads(bool z_in) {
 
 	boost::thread_group tgroup1;
 	boost::thread_group tgroup2;
+	R1_dups.keys.clear();
+	R1_dups.ids.clear();
+	R2_dups.keys.clear();
+	R2_dups.ids.clear();
+
+	learn_key_prefix(z_in);
+
+	if (bloom_bits && !z_in) {
+		get_unpaired_bloom<ifstream>(i1, i2, z_in);
+		return;
+	}
+
+	if (bloom_bits && z_in) {
+		get_unpaired_bloom<igzstream>(z1, z2, z_in);
+		return;
+	}
 
 	if (!z_in) {
 		// open the R1 mapping
@@ -532,7 +1936,8 @@ void Map_merger::get_unpaired_reads(bool z_in) {
 						&Map_merger::get_ids<ifstream>, 
 						this, 
 						boost::ref(i1), 
-						boost::ref(*R1_ids)
+						boost::ref(*R1_ids),
+						boost::ref(R1_dups)
 						)
 					);
 		}
@@ -551,7 +1956,8 @@ void Map_merger::get_unpaired_reads(bool z_in) {
 						&Map_merger::get_ids<ifstream>,
 						this,
 						boost::ref(i2),
-						boost::ref(*R2_ids)
+						boost::ref(*R2_ids),
+						boost::ref(R2_dups)
 						)
 					);
 		}
@@ -564,8 +1970,9 @@ void Map_merger::get_unpaired_reads(bool z_in) {
 
 	
 	if (z_in) {
-		// open the R1 mapping
+		// open the R1 mapping, inflated records are kept for the second pass
 		attach_stream<igzstream>(R1fn, z1, ios_base::in);
+		start_cache(0);
 	
 		// setup threads
 		for (uint8_t i = 0; i < n_threads; ++i) {
@@ -573,17 +1980,20 @@ void Map_merger::get_unpaired_reads(bool z_in) {
 						&Map_merger::get_ids<igzstream>, 
 						this, 
 						boost::ref(z1), 
-						boost::ref(*R1_ids)
+						boost::ref(*R1_ids),
+						boost::ref(R1_dups)
 						)
 					);
 		}
 		tgroup1.join_all();
+		end_cache(0);
 		// close R1 stream. REMEMBER to reopen
 		z1.close();
 		z1.clear();
 
 		// open R2 mapping
 		attach_stream<igzstream>(R2fn, z2, ios_base::in);
+		start_cache(1);
 		
 		// extract all IDs from R2
 		// setup threads
@@ -592,11 +2002,13 @@ void Map_merger::get_unpaired_reads(bool z_in) {
 						&Map_merger::get_ids<igzstream>,
 						this,
 						boost::ref(z2),
-						boost::ref(*R2_ids)
+						boost::ref(*R2_ids),
+						boost::ref(R2_dups)
 						)
 					);
 		}
 		tgroup2.join_all();
+		end_cache(1);
 		
 		// close R2 stream. REMEMBER to reopen
 		z2.close();
@@ -626,6 +2038,14 @@ void Map_merger::get_unpaired_reads(bool z_in) {
 			);
 	tgroup3.join_all();
 
+	n_unpaired_R1 = count_records(*unpaired_R1, R1_dups);
+	n_unpaired_R2 = count_records(*unpaired_R2, R2_dups);
+	if (count_only) {
+		print_counts();
+		remove_caches();
+		return;
+	}
+
 	// extrack unpaired IDs
 	boost::thread_group tgroup4;
 	boost::thread_group tgroup5;
@@ -674,39 +2094,16 @@ void Map_merger::get_unpaired_reads(bool z_in) {
 	}
 	
 	if (z_in) {
-		attach_stream<igzstream>(R1fn, z1, ios_base::in);
-		for (uint8_t i = 0; i < n_threads; ++i) {
-			// setup threads
-			tgroup4.create_thread(boost::bind(
-						&Map_merger::extract_reads<igzstream>,
-						this,
-						boost::ref(z1),
-						boost::ref(*unpaired_R1),
-						boost::ref(o1),
-						true
-						)
-					);
-		}
-		tgroup4.join_all();
-		z1.close();
-		z1.clear();
-	
-		attach_stream<igzstream>(R2fn, z2, ios_base::in);
-		for (uint8_t i = 0; i < n_threads; ++i) {
-			// setup a thread
-			tgroup5.create_thread(boost::bind(
-						&Map_merger::extract_reads<igzstream>,
-						this,
-						boost::ref(z2),
-						boost::ref(*unpaired_R2),
-						boost::ref(o2),
-						true
-						)
-					);
-		}
-		tgroup5.join_all();
-		z2.close();
-		z2.clear();
+		// from the caches of the first passes where they were kept
+		Cache_stream c1, c2;
+		if (cached[0]) {
+			extract_pass<Cache_stream>(c1, const_cast<char*>(cache_fn[0].c_str()), *unpaired_R1, o1);
+		} else { extract_pass<igzstream>(z1, R1fn, *unpaired_R1, o1); }
+
+		if (cached[1]) {
+			extract_pass<Cache_stream>(c2, const_cast<char*>(cache_fn[1].c_str()), *unpaired_R2, o2);
+		} else { extract_pass<igzstream>(z2, R2fn, *unpaired_R2, o2); }
+		remove_caches();
 	}
 
 	// close files
@@ -7,30 +7,105 @@
 #include <vector>
 #include <cstdint>
 #include "utils.h"
+#include "pair_table.h"
+#include "bloom_filter.h"
 #include <boost/thread.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/unordered_set.hpp>
+#include <deque>
 using namespace std;
 
 typedef boost::unordered::unordered_map<string, vector<string> > umsvs;
 typedef boost::unordered::unordered_set<string> uss;
 typedef boost::unordered::unordered_set<string>::iterator uss_it;
 
+// read IDs packed into 64 bit keys, see Map_merger::encode_key
+static const uint64_t RK_HASHED = static_cast<uint64_t>(1) << 63;
+
+// join strategies of merge_id_maps, see Map_merger::plan_join
+enum MM_PLANS {
+	MM_PLAN_MEMORY		=	0,
+	MM_PLAN_PARTITIONED	=	1
+};
+
+// table bytes per R1 record on top of the record (slots, length, slack)
+static const uint64_t MM_RECORD_OVERHEAD = 32;
+// part of the available memory the join plans for
+static const double MM_MEMORY_SHARE = 0.75;
+// most partitions planned, bounded by the open files
+static const uint64_t MM_MAX_PARTS = 512;
+// partitions when the memory is not known
+static const uint16_t MM_DEFAULT_PARTS = 64;
+// assumed inflation of compressed inputs
+static const uint64_t MM_GZ_RATIO = 5;
+
+// default size limit of an input cache of get_unpaired
+static const uint64_t MM_CACHE_LIMIT = static_cast<uint64_t>(16384) << 20;
+
+typedef boost::unordered::unordered_set<uint64_t> usu64;
+typedef boost::unordered::unordered_set<uint64_t>::iterator usu64_it;
+typedef boost::unordered::unordered_map<uint64_t, string> umu64s;
+typedef boost::unordered::unordered_map<uint64_t, string>::iterator umu64s_it;
+
+// read IDs of an input by key, hashed keys (RK_HASHED) are not unique so
+// their IDs are kept instead
+typedef struct read_set {
+	usu64 keys;
+	uss ids;
+} READ_SET;
+
+// repeated occurrences of read IDs, as READ_SET
+typedef struct read_list {
+	vector<uint64_t> keys;
+	vector<string> ids;
+} READ_LIST;
+
+// merge-join lookahead: key -> (record number, fields) and keys in read order
+typedef boost::unordered::unordered_map<uint64_t, pair<uint64_t, string> > umu64pr;
+typedef boost::unordered::unordered_map<uint64_t, pair<uint64_t, string> >::iterator umu64pr_it;
+typedef deque< pair<uint64_t, uint64_t> > dqpu64;
+
+/* Reads an input cache written by Map_merger::write_cache: the lines of the
+ * input with their keys, so later passes over a compressed input neither
+ * inflate nor parse it again. */
+class Cache_stream {
+	public:
+		Cache_stream() {}
+		void open(const char* fn, ios_base::openmode mode);
+		bool good() const;
+		void close();
+		void clear();
+		bool next(uint64_t& key, string& line);
+
+	private:
+		ifstream in;
+};
+
 class Map_merger {
 	public:
 		Map_merger(): R1fn(NULL), R2fn(NULL), outfile(NULL), unpR1(NULL), unpR2(NULL) {}
 		Map_merger(char* i1, char* i2, char* out);  
-		Map_merger(char* i1, char* i2, char* out, uint32_t mlines);  
 		Map_merger(char* i1, char* i2, char* o1, char* o2);  
 		virtual ~Map_merger();
 		void merge_id_maps(bool in_z, bool out_z);
 		void get_unpaired_reads(bool in_z);
-		void set_max_lines(uint32_t mlines);
+		void set_n_parts(uint16_t n);
+		void set_tmp_dir(const string& d);
+		void set_window(uint32_t w);
+		void set_unpaired_outputs(char* o1, char* o2);
+		void set_memory(uint64_t m);
+		void plan_join(bool z_in);
+		uint64_t get_plan_memory() const;
+		void set_bloom_bits(uint32_t b);
+		void set_count_only(bool c);
+		void set_cache_limit(uint64_t b);
 		void set_n_threads(uint8_t nthr);
 		void set_load_factor(uint32_t i);
 		void set_input_sep(const string& sep);
 		void set_output_sep(const string& sep);
 		void print_params();
+		void print_stats();
+		void print_counts();
 
 	private:
 		char* R1fn;
@@ -38,38 +113,180 @@ class Map_merger {
 		char* outfile;
 		char* unpR1;
 		char* unpR2;
+		bool z_unpR1;
+		bool z_unpR2;
 		
 		boost::mutex mtx;
 
 		string INPUT_SEP;
 		string OUTPUT_SEP;
 
-		uint32_t lines_read;
-		uint32_t max_lines;
 		uint8_t n_threads;
 		uint32_t load_factor;
 
-		umsvs* R1_hash;
+		// lookahead of the merge-join, 0 uses the partitioned join
+		uint32_t window;
+
+		READ_SET* unpaired_R1;
+		READ_SET* unpaired_R2;
+
+		READ_SET* R1_ids; 
+		READ_SET* R2_ids;
+
+		// repeated occurrences of IDs already in R1_ids / R2_ids, so the
+		// unpaired counts are records like those of the Bloom filter pass
+		READ_LIST R1_dups;
+		READ_LIST R2_dups;
 
-		uss* unpaired_R1;
-		uss* unpaired_R2;
+		// ID prefix shared by the packed keys
+		string key_prefix;
+		bool has_prefix;
 
-		uss* R1_ids; 
-		uss* R2_ids;
+		uint64_t encode_key(const string& id) const;
+		string decode_key(uint64_t key) const;
+		void learn_key_prefix(bool z_in);
 
 		void init_hashes();
+		// join strategy
+		uint8_t plan;
+		uint64_t plan_records;		// estimated R1 records
+		uint64_t plan_rec_len;		// average R1 record length
+		uint64_t plan_memory;		// predicted bytes
+		string plan_note;		// why the memory did not decide the plan
+		uint64_t memory_budget;
+
 		template<class T>
-			void read_id_map(T& inR1);
+			void load_table(T& in, Pair_table* t, umu64s* hashed, ofstream& u1);
 
-		template<class T1>
-			void match_reads(T1& inR2, ofstream& outf, bool z_out);
+		template<class T>
+			void probe_table(
+				T& in,
+				Pair_table* t,
+				umu64s* hashed,
+				ofstream& outf,
+				bool z_out,
+				ofstream& u2);
+
+		template<class T>
+			void join_in_memory(
+				T& in1,
+				T& in2,
+				ofstream& outf,
+				bool z_out,
+				ofstream& u1,
+				ofstream& u2);
+
+		// partitioned join
+		uint16_t n_parts;
+		string tmp_dir;
+		string run_id;			// temp file names, unique per instance
+		size_t next_part;
+		vector<uint64_t> part_records;	// R1 records per partition
+		vector<boost::mutex*> part_mtx;	// one lock per partition file
+
+		// largest R1 partition table
+		size_t peak_entries;
+		size_t peak_bytes;
+		double peak_overhead;
+
+		// R1 records whose key was already in the table, they go to the
+		// unpaired R1 output if there is one
+		uint64_t n_dup_R1;
+
+		void split_record(const string& line, string& key, string& fields) const;
 
 		template<class T>
-			void get_ids(T& in, uss& s);
+			void partition(T& in, vector<ofstream*>& parts, vector<uint64_t>& counts);
+
+		void join_partitions(
+				vector<string>& fn1,
+				vector<string>& fn2,
+				ofstream& outf,
+				bool z_out,
+				ofstream& u1,
+				ofstream& u2);
+
+		void write_buffer(string& buf, ofstream& outf, bool z_out);
+
+		void write_parts(
+				vector<ofstream*>& parts,
+				vector<string>& bufs,
+				vector<uint64_t>& n_recs,
+				vector<uint64_t>& counts);
+		void open_parts(const string& tag, vector<string>& fns, vector<ofstream*>& parts);
+		void close_parts(vector<ofstream*>& parts);
+		void unpaired_record(const string& key, const string& fields, string& out);
+
+		template<class T>
+			void merge_join(T& inR1, T& inR2, ofstream& outf, bool z_out);
+
+		void join_records(const string& key, const string& f1, const string& f2, string& out);
+
+		template<class T>
+			void get_ids(T& in, READ_SET& s, READ_LIST& dups);
 
 		template<class T1>
-			void extract_reads(T1& in, uss& s, ofstream& out, bool z_out);
+			void extract_reads(T1& in, READ_SET& s, ofstream& out, bool z_out);
+
+		void set_diff(READ_SET& s1, READ_SET& s2, READ_SET& r);
+		uint64_t count_records(const READ_SET& s, const READ_LIST& dups) const;
+		bool in_set(const READ_SET& s, uint64_t key, const string& line) const;
+
+		// Bloom filter unpaired detection
+		uint32_t bloom_bits;
+		size_t bloom_bytes;
+		bool count_only;
+		uint64_t n_unpaired_R1;
+		uint64_t n_unpaired_R2;
+
+		template<class T>
+			uint64_t estimate_records(char* fn, bool z_in, uint64_t& rec_len);
+
+		template<class T>
+			void bloom_build(T& in, Bloom_filter* b);
+
+		template<class T>
+			void bloom_split(
+				T& in,
+				Bloom_filter* check,
+				Bloom_filter* add,
+				vector<ofstream*>& parts,
+				ofstream& out,
+				uint64_t& n_unp);
+
+		void bloom_verify(vector<string>& fn1, vector<string>& fn2);
 
-		void set_diff(uss& s1, uss& s2, uss& r);
+		template<class T>
+			void get_unpaired_bloom(T& in1, T& in2, bool z_in);
+
+		template<class T>
+			void extract_pass(T& in, char* fn, READ_SET& s, ofstream& out);
+
+		template<class T>
+			void split_pass(
+				T& in,
+				char* fn,
+				Bloom_filter* check,
+				Bloom_filter* add,
+				vector<ofstream*>& parts,
+				ofstream& out,
+				uint64_t& n_unp);
+
+		// caches of compressed inputs for repeated passes
+		uint64_t cache_limit;
+		ofstream* cache_out;		// cache of the running pass or NULL
+		uint64_t cache_size;
+		bool cache_full;
+		string cache_fn[2];
+		bool cached[2];
+
+		void start_cache(uint8_t r);
+		void end_cache(uint8_t r);
+		void write_cache(const string& buf);
+
+		template<class T>
+			void read_batch(T& in, vector<string>& lines, vector<uint64_t>& keys);
+		void read_batch(Cache_stream& in, vector<string>& lines, vector<uint64_t>& keys);
+		void remove_caches();
 };
 #endif // __MAP_MERGER_H__
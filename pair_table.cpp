@@ -0,0 +1,172 @@
+#include <string>
+#include <vector>
+#include <cstring>
+#include "pair_table.h"
+using namespace std;
+
+// initial number of slots
+static const size_t PT_MIN_SLOTS = 1024;
+
+Pair_table::Pair_table() {
+	n = 0;
+	payload_bytes = 0;
+	PT_SLOT empty = {0, PT_EMPTY};
+	slots.assign(PT_MIN_SLOTS, empty);
+}
+
+Pair_table::~Pair_table() {}
+
+/* first slot probed for a key, read keys are structured so they are mixed
+ * (splitmix64 finalizer) and then scaled onto the slots
+ * arguments:
+ * 	key
+ * 	*/
+size_t Pair_table::slot_of(uint64_t key) const {
+	key ^= key >> 30;
+	key *= 0xbf58476d1ce4e5b9ULL;
+	key ^= key >> 27;
+	key *= 0x94d049bb133111ebULL;
+	key ^= key >> 31;
+	return (size_t) (((unsigned __int128) key * slots.size()) >> 64);
+}
+
+/* makes room for a number of entries and payload bytes so that filling the
+ * table does not reallocate
+ * arguments:
+ * 	number of entries
+ * 	total payload bytes
+ * 	*/
+void Pair_table::reserve(size_t entries, size_t bytes) {
+	size_t want = ((entries << 8) / PT_MAX_LOAD) + 1;
+	if (want > slots.size()) { rehash(want); }
+	arena.reserve(bytes + entries*sizeof(uint32_t));
+}
+
+/* drops all entries, keeps the allocated memory
+ * takes no arguments
+ * */
+void Pair_table::clear() {
+	PT_SLOT empty = {0, PT_EMPTY};
+	slots.assign(slots.size(), empty);
+	arena.clear();
+	n = 0;
+	payload_bytes = 0;
+}
+
+/* moves the entries to a new number of slots, the arena is untouched
+ * arguments:
+ * 	number of slots
+ * 	*/
+void Pair_table::rehash(size_t n_slots) {
+	PT_SLOT empty = {0, PT_EMPTY};
+	vector<PT_SLOT> old(n_slots, empty);
+	old.swap(slots);
+
+	for (size_t i = 0; i < old.size(); ++i) {
+		if (old[i].ref == PT_EMPTY) { continue; }
+		size_t s = slot_of(old[i].key);
+		while (slots[s].ref != PT_EMPTY) { s = (s + 1 == slots.size()) ? 0 : s + 1; }
+		slots[s] = old[i];
+	}
+}
+
+/* adds an entry, the first payload of a key is kept
+ * returns false if the key was already present
+ * arguments:
+ * 	key
+ * 	payload
+ * 	*/
+bool Pair_table::insert(uint64_t key, const string& payload) {
+	if (((n + 1) << 8) > PT_MAX_LOAD * slots.size()) { rehash(2 * slots.size()); }
+
+	size_t s = slot_of(key);
+	while (slots[s].ref != PT_EMPTY) {
+		if (slots[s].key == key) { return false; }
+		s = (s + 1 == slots.size()) ? 0 : s + 1;
+	}
+
+	uint32_t len = payload.length();
+	size_t at = arena.size();
+	arena.resize(at + sizeof(len) + len);
+	memcpy(&arena[at], &len, sizeof(len));
+	if (len) { memcpy(&arena[at + sizeof(len)], payload.data(), len); }
+
+	slots[s].key = key;
+	slots[s].ref = at;
+	n++;
+	payload_bytes += len;
+	return true;
+}
+
+/* looks up a key, the payload stays valid until the next insert or clear
+ * returns false if the key is absent
+ * arguments:
+ * 	key
+ * 	payload start (output)
+ * 	payload length (output)
+ * 	*/
+bool Pair_table::find(uint64_t key, const char*& payload, uint32_t& len) const {
+	size_t s;
+	if (!find(key, s)) { return false; }
+	get(s, key, payload, len);
+	return true;
+}
+
+/* looks up the slot of a key
+ * returns false if the key is absent
+ * arguments:
+ * 	key
+ * 	slot (output)
+ * 	*/
+bool Pair_table::find(uint64_t key, size_t& slot) const {
+	size_t s = slot_of(key);
+	while (slots[s].ref != PT_EMPTY) {
+		if (slots[s].key == key) {
+			slot = s;
+			return true;
+		}
+		s = (s + 1 == slots.size()) ? 0 : s + 1;
+	}
+	return false;
+}
+
+/* true if a slot holds an entry, slots run from 0 to get_n_slots() */
+bool Pair_table::used(size_t slot) const { return slots[slot].ref != PT_EMPTY; }
+
+/* reads the entry of a used slot
+ * arguments:
+ * 	slot
+ * 	key (output)
+ * 	payload start (output)
+ * 	payload length (output)
+ * 	*/
+void Pair_table::get(size_t slot, uint64_t& key, const char*& payload, uint32_t& len) const {
+	size_t at = slots[slot].ref & ~PT_MARKED;
+	key = slots[slot].key;
+	memcpy(&len, &arena[at], sizeof(len));
+	payload = &arena[at + sizeof(len)];
+}
+
+/* marks the entry of a used slot, safe to call from several threads */
+void Pair_table::mark(size_t slot) {
+	if (!(slots[slot].ref & PT_MARKED)) { __sync_fetch_and_or(&slots[slot].ref, PT_MARKED); }
+}
+
+bool Pair_table::marked(size_t slot) const {
+	return used(slot) && (slots[slot].ref & PT_MARKED);
+}
+
+/* memory accounting */
+size_t Pair_table::size() const { return n; }
+
+size_t Pair_table::get_n_slots() const { return slots.size(); }
+
+size_t Pair_table::get_payload_bytes() const { return payload_bytes; }
+
+size_t Pair_table::get_bytes() const { return slots.capacity()*sizeof(PT_SLOT) + arena.capacity(); }
+
+/* allocated bytes per entry on top of the payloads */
+double Pair_table::get_overhead() const {
+	if (n == 0) { return 0; }
+	return (double) (get_bytes() - payload_bytes) / n;
+}
@@ -0,0 +1,67 @@
+#ifndef __PAIR_TABLE_H__
+#define __PAIR_TABLE_H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+using namespace std;
+
+// slot without an entry
+static const uint64_t PT_EMPTY = ~static_cast<uint64_t>(0);
+
+// largest fill before the slots are doubled, in 1/256 (0.8)
+static const uint32_t PT_MAX_LOAD = 205;
+
+// flag in the arena offset of an entry that was paired
+static const uint64_t PT_MARKED = static_cast<uint64_t>(1) << 62;
+
+typedef struct pt_slot {
+	uint64_t	key;
+	uint64_t	ref;	// arena offset and PT_MARKED, PT_EMPTY for a free slot
+} PT_SLOT;
+
+/* Flat open-addressing table from 64 bit read keys to byte payloads (the R1
+ * fields) used to pair reads. Slots hold the key and the offset of the payload
+ * in one contiguous arena where it is stored behind its 32 bit length, so an
+ * entry costs 16 bytes per slot plus 4 bytes besides the payload itself and
+ * no allocation per record. Reserved up front the slots are 80% full, about
+ * 24 bytes of overhead per entry. Linear probing on a mixed key mapped onto
+ * any number of slots (not only powers of 2); entries are never
+ * removed, only the whole table is cleared. Lookups do not modify the table
+ * and can run concurrently once it is built. Entries can be marked through
+ * their slot, also while other threads look up keys, e.g. to find the
+ * records left without a mate by a sweep over the slots. */
+class Pair_table {
+	public:
+		Pair_table();
+		virtual ~Pair_table();
+
+		void reserve(size_t entries, size_t bytes);
+		void clear();
+
+		bool insert(uint64_t key, const string& payload);
+		bool find(uint64_t key, const char*& payload, uint32_t& len) const;
+
+		bool find(uint64_t key, size_t& slot) const;
+		bool used(size_t slot) const;
+		void get(size_t slot, uint64_t& key, const char*& payload, uint32_t& len) const;
+		void mark(size_t slot);
+		bool marked(size_t slot) const;
+
+		size_t size() const;
+		size_t get_n_slots() const;
+		size_t get_payload_bytes() const;
+		size_t get_bytes() const;
+		double get_overhead() const;
+
+	private:
+		vector<PT_SLOT> slots;
+		vector<char> arena;
+
+		size_t n;
+		size_t payload_bytes;
+
+		size_t slot_of(uint64_t key) const;
+		void rehash(size_t n_slots);
+};
+#endif //__PAIR_TABLE_H__
@@ -2,6 +2,8 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <algorithm>
+#include <cstring>
 #include "utils.h"
 #include "gzstream.h"
 #include "read_counter.h"
@@ -11,6 +13,77 @@
 using namespace std;
 using namespace utils;
 
+/* packs a UMI into a 64 bit code, up to 31 ACGT bases are stored 2 bits per
+ * base behind a leading 1, anything else is hashed into the upper half
+ * arguments:
+ * 	UMI
+ * 	*/
+static uint64_t umi_code(const string& umi) {
+	uint64_t c = 1;
+	if (umi.length() <= 31) {
+		for (size_t i = 0; i < umi.length(); ++i) {
+			switch (umi[i]) {
+				case 'A'	: c = c << 2;		break;
+				case 'C'	: c = (c << 2) | 1;	break;
+				case 'G'	: c = (c << 2) | 2;	break;
+				case 'T'	: c = (c << 2) | 3;	break;
+				default		: return boost::hash<string>()(umi) | (static_cast<uint64_t>(1) << 63);
+			}
+		}
+		return c;
+	}
+	return boost::hash<string>()(umi) | (static_cast<uint64_t>(1) << 63);
+}
+
+/* merges sorted distinct UMI codes into another sorted distinct set
+ * arguments:
+ * 	target set
+ * 	codes to add
+ * 	*/
+static void merge_umis(vector<uint64_t>& into, const vector<uint64_t>& from) {
+	if (into.empty()) {
+		into = from;
+		return;
+	}
+	vector<uint64_t> res;
+	res.reserve(into.size() + from.size());
+	set_union(into.begin(), into.end(), from.begin(), from.end(), back_inserter(res));
+	into.swap(res);
+}
+
+/* finds the fields of a record the way utils::split_string cuts them,
+ * without copying them
+ * arguments:
+ * 	record
+ * 	separator
+ * 	field starts (output)
+ * 	field ends (output)
+ * 	*/
+static void split_fields(const string& str, const string& sep, vector<size_t>& from, vector<size_t>& to) {
+	from.clear();
+	to.clear();
+	for (size_t p = 0, q = 0; p != str.npos; p = q) {
+		q = str.find(sep, p + 1);
+		from.push_back(p + sep.size()*(p != 0));
+		to.push_back((q == str.npos) ? str.length() : q);
+	}
+}
+
+/* utils::seq_qual of a field of a record
+ * arguments:
+ * 	record
+ * 	field start
+ * 	field end
+ * 	minimum quality
+ * 	*/
+static int low_quality(const string& l, size_t from, size_t to, int q) {
+	int res = 0;
+	for (size_t i = from; i < to; ++i) {
+		if (static_cast<int>(l[i]) - 33 < q) { res++; }
+	}
+	return res;
+}
+
 /* constructor
  * sets up stuff, and initialize hashes on the hreap
  * arguments:
@@ -54,6 +127,11 @@ void Read_counter::set_defaults() {
 	max_lq_bases = 		5;
 	min_qual = 		20;
 
+	extra_cols = 		0;
+	with_umis =		false;
+	collapsed_input =	false;
+	edit_reads =		false;
+
 	n_threads = 		15;
 
 	collapser_bite_size = 	100000;
@@ -130,6 +208,10 @@ void Read_counter::print_params() {
 	cout << "undef tag:	" << IDX_UNDEF_TAG << endl;
 	cout << "Min quality:	" << +min_qual << endl;
 	cout << "Max lq_bases:	" << +max_lq_bases << endl;
+	cout << "Extra columns:	" << +extra_cols << endl;
+	cout << "with_umis:	" << with_umis << endl;
+	cout << "collapsed in:	" << collapsed_input << endl;
+	cout << "edit distance:	" << edit_reads << endl;
 
 	cout << "Collapse bite:	" << collapser_bite_size << endl;
 	cout << "Counter bite	" << counter_bite_size << endl;
@@ -142,6 +224,8 @@ void Read_counter::print_params() {
 void Read_counter::init_hashes() {
 	counts_hash	= new umsi;
 	translated	= new umsi;
+	umis_hash	= new umsv;
+	molecules	= new umsv;
 
 	stats_idx       = new umsi;
 	for (size_t i = 0; i < read_maps.size(); ++i) {
@@ -155,6 +239,8 @@ void Read_counter::init_hashes() {
 Read_counter::~Read_counter() {
 	delete(counts_hash);
 	delete(translated);
+	delete(umis_hash);
+	delete(molecules);
 
 	for (size_t i = 0; i < stats_r.size(); ++i) {
 		delete(stats_r.at(i));
@@ -202,6 +288,16 @@ void Read_counter::set_min_qual(uint8_t n) { min_qual = n; }
 
 void Read_counter::set_max_lq_bases(uint8_t n) { max_lq_bases = n; }
 
+void Read_counter::set_extra_cols(uint8_t n) { extra_cols = n; }
+
+void Read_counter::set_with_umis(bool i) { with_umis = i; }
+
+void Read_counter::set_collapsed_input(bool i) { collapsed_input = i; }
+
+/* setter for matching reads to the library by edit distance, the index
+ * keeps Hamming distance */
+void Read_counter::set_edit_reads(bool i) { edit_reads = i; }
+
 /* filenames */
 void Read_counter::set_input(char* f) { infile = f; }
 
@@ -240,34 +336,44 @@ void Read_counter::set_with_raw_stats(bool i) { with_raw_stats = i; }
 void Read_counter::set_collapse_q_fails(bool i) { collapse_q_fails = i; }
 
 /* used to reduce the complexity of the data by lumping together identical reads
- * drastically improves performance */
+ * drastically improves performance. Records are counted under packed keys
+ * (see key_table.h) without allocating per read, records that do not pack
+ * (bases other than ACGT, too many or too long reads) under their string key.
+ * The packed keys are turned into string keys once per bite */
 template<class T>
 void Read_counter::collapse_reads(
 		T& in,
-		umss& sample_map) {
+		Seq_cache& samples) {
 
 	// for processing the input
 	string line;
 	vector<string>* in_buffer = new vector<string>;
-	vector<string> chunks;
+	vector<size_t> from;
+	vector<size_t> to;
+	string idx;
 	string key;
+	string umi;
+	vector<bool> fails;
+	PACKED_KEY pk;
 
 	// temporary hashes
-	umsi* temp_counts = new umsi;;
-	umsi* temp_stats = new umsi;
-	umss* mapped = new umss;
-
-	vector<string> lookup;
-	for (umss_it it = sample_map.begin(); it != sample_map.end(); ++it) {
-		lookup.push_back(it->first);
-	}
+	Key_table* packed = new Key_table;
+	vector< vector<uint64_t> > packed_umis;
+	umsi* temp_counts = new umsi;
+	umsi* temp_stats = new umsi;	// per index sequence
+	umsi* temp_codes = new umsi;	// sample code of each index sequence
+	umsv* temp_umis = new umsv;
 
 	while (1) {
 		in_buffer->clear();
 		in_buffer->reserve(collapser_bite_size);
 
+		packed->clear();
+		for (size_t i = 0; i < packed_umis.size(); ++i) { packed_umis.at(i).clear(); }
 		temp_counts->clear();
 		temp_stats->clear();
+		temp_codes->clear();
+		temp_umis->clear();
 
 		// critical
 		// lock mutex
@@ -291,64 +397,86 @@ void Read_counter::collapse_reads(
 		
 		// iterate over the in_buffer
 		for (size_t j = 0; j < in_buffer->size(); ++j) {
-			// set sample as undefined by default
-			string sample = IDX_UNDEF_TAG;
-			chunks = split_string(in_buffer->at(j), INPUT_SEP);
-
-			sample = match_with_helper(
-						chunks.at(1),
-						lookup,
-						sample_map,
-						*mapped,
-						index_mm,
-						IDX_UNDEF_TAG); 
-
-			if (with_raw_stats) {
-				(*temp_stats)[sample + OUTPUT_SEP + chunks.at(1)]++;
+			const string& l = in_buffer->at(j);
+			split_fields(l, INPUT_SEP, from, to);
+
+			// sample code, 0 for undefined
+			idx.assign(l, from.at(1), to.at(1) - from.at(1));
+			uint32_t code = samples.find(idx) + 1;
+
+			if (with_raw_stats && ((*temp_stats)[idx]++ == 0)) {
+				(*temp_codes)[idx] = code;
 			}
 			
 			// check if the record is ok
-			size_t rec_sz = chunks.size() - 1;
-			uint8_t nr = (uint8_t) (rec_sz/3);
-			if ((nr < 1) || (rec_sz % 3 > 0)) { 
+			// every read is index, sequence, quality and the extra columns
+			size_t rec_w = 3 + extra_cols;
+			size_t rec_sz = from.size() - 1;
+			uint8_t nr = (uint8_t) (rec_sz/rec_w);
+			if ((nr < 1) || (rec_sz % rec_w > 0)) { 
 				report_error(__FILE__, __func__, RC_CORRUPT_RECORD);
-				report_error(__FILE__, __func__,  in_buffer->at(j));
+				report_error(__FILE__, __func__,  l);
 				exit(RCEC_COLLAPSER_CORRUPT_RECORD); 
 			}
 			
 			// always do read1, we assume at least 1 read and check sequence quality
-			vector<string> seqs;
-			string k;
+			// if any of the reads are poor quality and they are collapsed
+			// tag the whole thing as bad
+			bool failed = false;
+			fails.assign(nr, false);
 			for (uint8_t r = 0; r < nr; ++r) {
-				k = (seq_qual(chunks.at(3*r+3), min_qual) <= max_lq_bases) ? chunks.at(3*r+2) : READ_Q_FAIL_TAG;
-				seqs.push_back(k);
+				size_t f = rec_w*r + 3;
+				fails[r] = (low_quality(l, from.at(f), to.at(f), min_qual) > max_lq_bases);
+				if (fails[r]) { failed = true; }
 			}
-			
-			// collapse the quality failed reads?
-			bool failed = false;
-			if (collapse_q_fails) {
-			// if any of the reads are poor quality tag the whole thing as bad
-				for (size_t i = 0; i < seqs.size(); ++i) {
-					if (seqs.at(i).compare(READ_Q_FAIL_TAG) == 0) {
-						failed = true;
-					}
+			if (failed && collapse_q_fails) { fails.assign(nr, true); }
+
+			// add to the temporary counts
+			uint32_t e = KT_EMPTY;
+			if (pack_record(l, from, to, nr, fails, code, pk)) {
+				e = packed->add(pk, 1);
+			} else {
+				key.clear();
+				for (uint8_t r = 0; r < nr; ++r) {
+					size_t s = rec_w*r + 2;
+					if (fails[r]) { key += READ_Q_FAIL_TAG; }
+					else { key.append(l, from.at(s), to.at(s) - from.at(s)); }
+					key += HASH_SEP;
 				}
-				
-				if (failed) {
-					for (size_t i = 0; i < seqs.size(); ++i) {
-						seqs.at(i) = READ_Q_FAIL_TAG;
-					}
+				key += code ? samples.get_lookup().get_id(code - 1) : IDX_UNDEF_TAG;
+				(*temp_counts)[key]++;
+			}
+
+			// UMIs of all reads of the record form the molecule
+			if (with_umis) {
+				umi.clear();
+				for (uint8_t r = 0; r < nr; ++r) {
+					size_t u = rec_w*r + 4;
+					umi.append(l, from.at(u), to.at(u) - from.at(u));
+				}
+				if (e == KT_EMPTY) {
+					(*temp_umis)[key].push_back(umi_code(umi));
+				} else {
+					if (e >= packed_umis.size()) { packed_umis.resize(e + 1); }
+					packed_umis.at(e).push_back(umi_code(umi));
 				}
 			}
-			
-			string key;
-			for (size_t i = 0; i < seqs.size(); ++i) {
-				key += seqs.at(i) + HASH_SEP;
+		}
+
+		// string keys of the packed records
+		for (uint32_t e = 0; e < packed->size(); ++e) {
+			key = unpack_key(packed->key(e), samples.get_lookup());
+			(*temp_counts)[key] += packed->count(e);
+			if (with_umis) {
+				vector<uint64_t>& u = (*temp_umis)[key];
+				u.insert(u.end(), packed_umis.at(e).begin(), packed_umis.at(e).end());
 			}
-			key += sample;
-			seqs.clear();
-			// add to temporary counts hash
-			(*temp_counts)[key]++;
+		}
+
+		// deduplicate outside the lock
+		for (umsv_it it = temp_umis->begin(); it != temp_umis->end(); ++it) {
+			sort(it->second.begin(), it->second.end());
+			it->second.erase(unique(it->second.begin(), it->second.end()), it->second.end());
 		}
 		
 		// critical
@@ -358,90 +486,199 @@ void Read_counter::collapse_reads(
 			(*counts_hash)[it->first] += it->second;
 		}
 
+		for (umsv_it it = temp_umis->begin(); it != temp_umis->end(); ++it) {
+			merge_umis((*umis_hash)[it->first], it->second);
+		}
+
 		// write stats if needed
 		if (with_raw_stats) {
 			for (umsi_it it = temp_stats->begin(); it != temp_stats->end(); ++it) {
-				 (*stats_idx)[it->first] += it->second;
+				uint32_t c = (*temp_codes)[it->first];
+				const string& sample = c ? samples.get_lookup().get_id(c - 1) : IDX_UNDEF_TAG;
+				(*stats_idx)[sample + OUTPUT_SEP + it->first] += it->second;
 			}
 		}
 		collapse_mtx.unlock();
 		// end critical
 	}
 	// celanup
+	delete(packed);
 	delete(temp_counts);
-	delete(mapped);
 	delete(in_buffer);
 	delete(temp_stats);
+	delete(temp_codes);
+	delete(temp_umis);
 }
 
-/* main read counter function
- * argumenst:
- *	output final hash with human readable IDs and counts
- *	hash mapping sequences to human readables for R1
- *	hash mapping sequences to human readables for R2
- *	*/
+/* packs the reads of a record and its sample into a key
+ * returns false if the record does not fit the key
+ * arguments:
+ * 	record
+ * 	field starts
+ * 	field ends
+ * 	number of reads
+ * 	quality fail flag per read
+ * 	sample code
+ * 	key (output)
+ * 	*/
+bool Read_counter::pack_record(
+		const string& l,
+		const vector<size_t>& from,
+		const vector<size_t>& to,
+		uint8_t nr,
+		const vector<bool>& fails,
+		uint32_t code,
+		PACKED_KEY& k) {
+
+	if ((nr > KT_MAX_READS) || (code > KT_MAX_SAMPLE)) { return false; }
+	memset(k.w, 0, sizeof(k.w));
+
+	uint64_t layout = nr | (static_cast<uint64_t>(code) << 31);
+	size_t rec_w = 3 + extra_cols;
+	size_t bit = 0;
+	for (uint8_t r = 0; r < nr; ++r) {
+		if (fails[r]) {
+			layout |= static_cast<uint64_t>(1) << (3 + r);
+			continue;
+		}
+
+		size_t s = rec_w*r + 2;
+		size_t len = to.at(s) - from.at(s);
+		if ((len > KT_MAX_READ_LEN) || ((bit >> 1) + len > KT_MAX_BASES)) { return false; }
+		layout |= static_cast<uint64_t>(len) << (7 + 6*r);
+
+		for (size_t i = from.at(s); i < to.at(s); ++i) {
+			uint64_t c;
+			switch (l[i]) {
+				case 'A'	: c = 0;	break;
+				case 'C'	: c = 1;	break;
+				case 'G'	: c = 2;	break;
+				case 'T'	: c = 3;	break;
+				default		: return false;
+			}
+			k.w[bit >> 6] |= c << (bit & 63);
+			bit += 2;
+		}
+	}
+	k.w[KT_WORDS - 1] = layout;
+	return true;
+}
+
+/* the counts hash key of a packed key: the reads separated by HASH_SEP and
+ * the sample
+ * arguments:
+ * 	key
+ * 	sample lookup
+ * 	*/
+string Read_counter::unpack_key(const PACKED_KEY& k, const Seq_lookup& samples) {
+	static const char bases[] = "ACGT";
+	uint64_t layout = k.w[KT_WORDS - 1];
+	uint8_t nr = layout & 7;
+
+	string key;
+	size_t bit = 0;
+	for (uint8_t r = 0; r < nr; ++r) {
+		if ((layout >> (3 + r)) & 1) {
+			key += READ_Q_FAIL_TAG;
+		} else {
+			size_t len = (layout >> (7 + 6*r)) & KT_MAX_READ_LEN;
+			for (size_t i = 0; i < len; ++i) {
+				key.push_back(bases[(k.w[bit >> 6] >> (bit & 63)) & 3]);
+				bit += 2;
+			}
+		}
+		key += HASH_SEP;
+	}
+
+	uint32_t code = (layout >> 31) & KT_MAX_SAMPLE;
+	key += code ? samples.get_id(code - 1) : IDX_UNDEF_TAG;
+	return key;
+}
+
+/* reads input collapsed by extract_reads into the counts hash, replaces
+ * collapse_reads, records are
+ * 	index, one sequence per ROI, extra columns (per record), count
+ * where each sequence may already be the quality fail tag
+ * arguments:
+ * 	input stream
+ * 	cached sample lookup
+ * 	*/
+template<class T>
+void Read_counter::load_collapsed(
+		T& in,
+		Seq_cache& samples) {
 
-void Read_counter::count_reads(vector<umss>& maps) { 
 	string line;
-	vector<string>* in_buffer = new vector<string>;
 	vector<string> chunks;
-	vector<string> pair;
 
-	static umsi_it main_it = counts_hash->begin();
+	// index, one column per ROI, the extra columns of the record and the count
+	while (in.is_open() ? getline(in, line) : getline(cin, line)) {
+		chunks = split_string(line, INPUT_SEP);
+		size_t n_reads = (chunks.size() < 3 + extra_cols) ? 0 : chunks.size() - 2 - extra_cols;
+		if (n_reads == 0) {
+			report_error(__FILE__, __func__, RC_CORRUPT_RECORD);
+			report_error(__FILE__, __func__, line);
+			exit(RCEC_COLLAPSER_CORRUPT_RECORD);
+		}
 
-	// temporary hashes
-	umsi* temp_counts = new umsi;
-	umsi* buffer = new umsi;
+		string sample = match_with_helper(
+					chunks.at(0),
+					samples,
+					IDX_UNDEF_TAG);
+		uint32_t n = atoi(chunks.back().c_str());
+
+		if (with_raw_stats) {
+			(*stats_idx)[sample + OUTPUT_SEP + chunks.at(0)] += n;
+		}
 
-	// used for find_likely_match function
-	vector< vector<string> > lookup;
+		// a quality failed read fails the whole record if collapsing them
+		bool failed = false;
+		for (size_t r = 0; r < n_reads; ++r) {
+			if (chunks.at(1 + r).compare(READ_Q_FAIL_TAG) == 0) { failed = true; }
+		}
 
-	// temporary hases
-	vector<umss*> mapped;
-	for (size_t i = 0; i < maps.size(); ++i) {
-		vector<string> l;
-		for (umss_it it = maps.at(i).begin(); it != maps.at(i).end(); ++it) {
-			l.push_back(it->first);
+		string key;
+		for (size_t r = 0; r < n_reads; ++r) {
+			key += ((failed && collapse_q_fails) ? READ_Q_FAIL_TAG : chunks.at(1 + r)) + HASH_SEP;
 		}
-		lookup.push_back(l);
-		l.clear();
+		key += sample;
 
-		mapped.push_back(new umss);
+		(*counts_hash)[key] += n;
+		if (with_umis) { (*umis_hash)[key].push_back(umi_code(chunks.at(1 + n_reads))); }
 	}
 
-	vector<umsi*> temp_stats;
-	for (size_t i = 0; i < stats_r.size(); ++i) {
-		temp_stats.push_back(new umsi);
+	for (umsv_it it = umis_hash->begin(); it != umis_hash->end(); ++it) {
+		sort(it->second.begin(), it->second.end());
+		it->second.erase(unique(it->second.begin(), it->second.end()), it->second.end());
 	}
+}
 
-	// check if we reached the end of the count hash
-	while (main_it != counts_hash->end()) {
-		in_buffer->clear();
-		in_buffer->reserve(counter_bite_size);
-		temp_counts->clear();
-		buffer->clear();
+/* main read counter function, translates ranges of counter_bite_size
+ * entries of the snapshot of the counts hash, claimed without a lock, into
+ * the accumulators of the thread
+ * argumenst:
+ *	cached lookups of the library sequences, one per read
+ *	accumulators of the thread
+ *	*/
+void Read_counter::count_reads(vector<Seq_cache*>& lookups, COUNT_PART& part) { 
+	vector<string> pair;
+	string k;
+	string key;
 
-		for (size_t i = 0; i < temp_stats.size(); ++i) {
-			temp_stats.at(i)->clear();
-		}
+	part.stats.resize(stats_r.size());
+	size_t bite = counter_bite_size ? counter_bite_size : 1;
 
-		// critical
-		// lock mutex and read from counts hash and populate the buffer hash
-		counter_mtx.lock();
-		for (uint32_t j = 0; j < counter_bite_size; ++j) {
-			if (main_it == counts_hash->end()) { break; }
-			(*buffer)[main_it->first] = main_it->second;
-			++main_it;
-		}
-		counter_mtx.unlock();
-		// end critical
-		
-		// iterate over the buffer hash
-		for (umsi_it br_i = buffer->begin(); br_i != buffer->end(); ++br_i) {
-			string k;
-			string p_str = br_i->first;
+	// claim ranges until the snapshot is done
+	while (1) {
+		size_t from = __atomic_fetch_add(&next_entry, bite, __ATOMIC_RELAXED);
+		if (from >= snapshot.size()) { break; }
+		size_t to = min(from + bite, snapshot.size());
+
+		for (size_t e = from; e < to; ++e) {
+			const string& p_str = snapshot[e]->first;
+			uint32_t n = snapshot[e]->second;
 			pair = split_string(p_str, HASH_SEP);
-			string key = pair.back() + HASH_SEP;
+			key = pair.back() + HASH_SEP;
 
 			int num_reads = pair.size() - 1;
 
@@ -451,7 +688,7 @@ void Read_counter::count_reads(vector<umss>& maps) {
 				exit(RCEC_COUNTER_CORRUPT_RECORD);
 			}
 
-			if (num_reads > maps.size()) {
+			if (num_reads > lookups.size()) {
 				report_error(__FILE__, __func__, RC_BAD_MAPPING);
 				report_error(__FILE__, __func__, p_str);
 				exit(RCEC_COUNTER_BAD_MAPPING);
@@ -464,14 +701,11 @@ void Read_counter::count_reads(vector<umss>& maps) {
 				if (pair.at(r).compare(READ_Q_FAIL_TAG) == 0) { k = READ_Q_FAIL_TAG; } 
 				else { k = match_with_helper(
 						pair.at(r),
-						lookup.at(r),
-						maps.at(r),
-						*mapped.at(r),
-						mms.at(r),
+						*lookups.at(r),
 						READ_UNKNOWN_TAG); }
 			
 				if (with_raw_stats) {
-					(*temp_stats.at(r))[k + OUTPUT_SEP + pair.at(r)] += br_i->second;
+					part.stats.at(r)[k + OUTPUT_SEP + pair.at(r)] += n;
 				}
 
 				if (r == num_reads - 1) {
@@ -481,78 +715,69 @@ void Read_counter::count_reads(vector<umss>& maps) {
 				}
 			}
 
-			// add to the temporary counts hash
-			(*temp_counts)[key] += br_i->second;
-		}
-		
-		// critical
-		// lock mutex and update hashes
-		counter_mtx.lock();
-		for (umsi_it it = temp_counts->begin(); it != temp_counts->end(); ++it) {
 			// filter depending on output filtering options
-			if ((it->first.find(READ_Q_FAIL_TAG) != string::npos) && (!with_fails)) { continue; }
-			if ((it->first.find(READ_UNKNOWN_TAG) != string::npos) && (!with_unknowns)) { continue; }
-			if ((it->first.find(IDX_UNDEF_TAG) != string::npos) && (!with_undefs)) { continue; }
-			(*translated)[it->first] += it->second;
-		}
-
-		if (with_raw_stats) {
-			for (size_t i = 0; i < temp_stats.size(); ++i) {
-				for (umsi_it it = temp_stats.at(i)->begin(); it != temp_stats.at(i)->end(); ++it) {
-					(*stats_r.at(i))[it->first] += it->second;
-				}
+			if ((key.find(READ_Q_FAIL_TAG) != string::npos) && (!with_fails)) { continue; }
+			if ((key.find(READ_UNKNOWN_TAG) != string::npos) && (!with_unknowns)) { continue; }
+			if ((key.find(IDX_UNDEF_TAG) != string::npos) && (!with_undefs)) { continue; }
+			part.translated[key] += n;
+
+			// umis_hash is only read once collapsing is done
+			if (with_umis) {
+				umsv_it u = umis_hash->find(p_str);
+				if (u != umis_hash->end()) { merge_umis(part.molecules[key], u->second); }
 			}
 		}
-		counter_mtx.unlock();
-		// end critical
 	}
-	// cleanup
-	delete(in_buffer);
-	delete(temp_counts);
-	
-	for (size_t i = 0; i < mapped.size(); ++i) {
-		delete(mapped.at(i));
+}
+
+/* adds the accumulators of one thread to those of another and empties them
+ * arguments:
+ * 	accumulators to add to
+ * 	accumulators to add
+ * 	*/
+void Read_counter::merge_parts(COUNT_PART& into, COUNT_PART& from) {
+	if (into.translated.size() < from.translated.size()) {
+		into.translated.swap(from.translated);
+		into.molecules.swap(from.molecules);
+		into.stats.swap(from.stats);
 	}
-	
-	for (size_t i = 0; i < temp_stats.size(); ++i) {
-		delete(temp_stats.at(i));
+
+	for (umsi_it it = from.translated.begin(); it != from.translated.end(); ++it) {
+		into.translated[it->first] += it->second;
+	}
+	for (umsv_it it = from.molecules.begin(); it != from.molecules.end(); ++it) {
+		merge_umis(into.molecules[it->first], it->second);
 	}
 
-	delete(buffer);
+	into.stats.resize(from.stats.size());
+	for (size_t i = 0; i < from.stats.size(); ++i) {
+		for (umsi_it it = from.stats.at(i).begin(); it != from.stats.at(i).end(); ++it) {
+			into.stats.at(i)[it->first] += it->second;
+		}
+	}
+
+	from.translated.clear();
+	from.molecules.clear();
+	from.stats.clear();
 }
 
-/* attempts to match sequence to a human-redable ID using a helper hash of
- * already known mappings
+/* attempts to match sequence to a human-redable ID, the lookup runs once
+ * per sequence and run, later calls are answered by the shared cache
  * arguments:
  * 	sequence to be matched
- * 	vector of luukup sequences
- *	hash mapping sequences to human readables
- *	temporary mapped hash
- *	allowed mismatches
+ * 	cached lookup of the library sequences and their human readables
+ *	tag returned if there is no unique match
  *	*/
 string Read_counter::match_with_helper(
-		string& seq, 
-		vector<string>& lookup, 
-		umss& mapping, 
-		umss& tmm,
-		uint8_t mm,
-		string& tag) {
-
-	// if not found n the mapped hash try to figure it ouy
-	if (tmm.find(seq) == tmm.end()) {
-		int m_idx = find_likely_match(seq, lookup, mm);
-		if (m_idx >= 0) {
-			// new mapping discovered, add it to the temporary mapped hash
-			tmm[seq] = mapping[lookup.at(m_idx)];
-			return tmm[seq];
-		} else {
-			// cannot figure it out
-			return tag;
-		}
-	} else {
-		// if found in the mapped hash
-		return tmm[seq];		
-	}
+		const string& seq, 
+		Seq_cache& cache,
+		const string& tag) {
+
+	int32_t m_idx = cache.find(seq);
+	if (m_idx >= 0) { return cache.get_lookup().get_id(m_idx); }
+
+	// cannot figure it out
+	return tag;
 }
 
 /* a helper function for populating mapping hashes
@@ -586,6 +811,23 @@ umss Read_counter::load_mapping(char* fn, bool rc) {
 	return res;
 }
 
+/* indexes a mapping hash for match_with_helper, the sequences are added
+ * in the order of the hash like the linear search used to see them
+ * arguments:
+ * 	mapping hash
+ * 	allowed mismatches
+ * 	boolean count mismatches as edit distance
+ * 	*/
+Seq_lookup* Read_counter::build_lookup(umss& mapping, uint8_t mm, bool edits) {
+	Seq_lookup* l = new Seq_lookup;
+	l->set_edits(edits);
+	for (umss_it it = mapping.begin(); it != mapping.end(); ++it) {
+		l->add(it->first, it->second);
+	}
+	l->build(mm);
+	return l;
+}
+
 /* public member wrapper to do the job
  * call this from app
  * takes no arguments
@@ -594,16 +836,49 @@ void Read_counter::count(bool in_z) {
 	// clear hashes just in case we are re-using the object
 	counts_hash->clear();
 	translated->clear();
+	umis_hash->clear();
+	molecules->clear();
+	stats_idx->clear();
+	for (size_t i = 0; i < stats_r.size(); ++i) { stats_r.at(i)->clear(); }
+
+	// the UMI is the first extra column
+	if (with_umis && (extra_cols < 1)) { extra_cols = 1; }
 
-	vector<umss> maps;
+	// the libraries are indexed once with their mismatch neighbors and
+	// shared by the threads
+	vector<Seq_lookup*> lookups;
 	for (size_t i = 0; i < read_maps.size(); ++i) {
-		maps.push_back(load_mapping(read_maps.at(i), rcs.at(i)));
+		umss m = load_mapping(read_maps.at(i), rcs.at(i));
+		lookups.push_back(build_lookup(m, mms.at(i), edit_reads));
 	}
 
 	umss sample_hash = load_mapping(sample_map, idxrc);
+	Seq_lookup* sample_lookup = build_lookup(sample_hash, index_mm, false);
+
+	// the lookups are memoized in caches shared by the threads
+	Seq_cache* samples = new Seq_cache(*sample_lookup);
+	vector<Seq_cache*> caches;
+	for (size_t i = 0; i < lookups.size(); ++i) {
+		caches.push_back(new Seq_cache(*lookups.at(i)));
+	}
+
+	// collapsed input is small, it is read in directly
+	if (collapsed_input) {
+		if (in_z) {
+			igzstream z1;
+			if (infile) { attach_stream<igzstream>(infile, z1, std::ios_base::in); }
+			load_collapsed<igzstream>(z1, *samples);
+			if (z1.is_open()) { z1.close(); }
+		} else {
+			ifstream i1;
+			if (infile) { attach_stream<ifstream>(infile, i1, std::ios_base::in); }
+			load_collapsed<ifstream>(i1, *samples);
+			if (i1.is_open()) { i1.close(); }
+		}
+	}
 
 	// input not zipped
-	if (!in_z) {
+	if (!in_z && !collapsed_input) {
 		ifstream i1;
 		if (infile) { attach_stream<ifstream>(infile, i1, std::ios_base::in); }
 	
@@ -615,7 +890,7 @@ void Read_counter::count(bool in_z) {
 						&Read_counter::collapse_reads<ifstream>,
 						this,
 						boost::ref(i1),
-						boost::ref(sample_hash)
+						boost::ref(*samples)
 						)
 					);
 		}
@@ -624,7 +899,7 @@ void Read_counter::count(bool in_z) {
 	}
 
 	// zipped input
-	if (in_z) {
+	if (in_z && !collapsed_input) {
 		igzstream z1;
 		if (infile) { attach_stream<igzstream>(infile, z1, std::ios_base::in); }
 	
@@ -636,7 +911,7 @@ void Read_counter::count(bool in_z) {
 						&Read_counter::collapse_reads<igzstream>,
 						this,
 						boost::ref(z1),
-						boost::ref(sample_hash)
+						boost::ref(*samples)
 						)
 					);
 		}
@@ -644,18 +919,94 @@ void Read_counter::count(bool in_z) {
 		if (z1.is_open()) { z1.close(); }
 	}
 
+	// the collapsed entries do not change while they are counted, the
+	// threads claim ranges of a snapshot of them
+	snapshot.clear();
+	snapshot.reserve(counts_hash->size());
+	for (umsi_it it = counts_hash->begin(); it != counts_hash->end(); ++it) {
+		snapshot.push_back(&(*it));
+	}
+	next_entry = 0;
+
 	// setup threads for counting the reads
+	vector<COUNT_PART> parts(n_threads ? n_threads : 1);
 	boost::thread_group tgroup2;
-	for (uint8_t i = 0; i < n_threads; ++i) {
+	for (size_t i = 0; i < parts.size(); ++i) {
 		tgroup2.create_thread(
 				boost::bind(
 					&Read_counter::count_reads,
 					this,
-					boost::ref(maps)
+					boost::ref(caches),
+					boost::ref(parts.at(i))
 					)
 				);
 	}
 	tgroup2.join_all();
+
+	// pairwise merges of the accumulators, the pairs of a round in parallel
+	for (size_t step = 1; step < parts.size(); step *= 2) {
+		boost::thread_group tgroup3;
+		for (size_t i = 0; i + step < parts.size(); i += 2*step) {
+			tgroup3.create_thread(
+					boost::bind(
+						&Read_counter::merge_parts,
+						this,
+						boost::ref(parts.at(i)),
+						boost::ref(parts.at(i + step))
+						)
+					);
+		}
+		tgroup3.join_all();
+	}
+	translated->swap(parts.at(0).translated);
+	molecules->swap(parts.at(0).molecules);
+	for (size_t i = 0; i < parts.at(0).stats.size(); ++i) {
+		stats_r.at(i)->swap(parts.at(0).stats.at(i));
+	}
+	snapshot.clear();
+
+	cache_stats.clear();
+	cache_stats.push_back(cache_stat(*samples));
+	for (size_t i = 0; i < caches.size(); ++i) {
+		cache_stats.push_back(cache_stat(*caches.at(i)));
+	}
+
+	// cleanup
+	for (size_t i = 0; i < lookups.size(); ++i) {
+		delete(caches.at(i));
+		delete(lookups.at(i));
+	}
+	delete(samples);
+	delete(sample_lookup);
+}
+
+/* distinct sequences, hits and misses of a cache
+ * arguments:
+ * 	cache
+ * 	*/
+CACHE_STAT Read_counter::cache_stat(const Seq_cache& c) {
+	CACHE_STAT s;
+	s.size = c.size();
+	s.hits = c.get_hits();
+	s.misses = c.get_misses();
+	return s;
+}
+
+/* prints how often the shared caches answered a lookup, index first then
+ * the reads
+ * takes no arguments
+ * */
+void Read_counter::print_stats() {
+	for (size_t i = 0; i < cache_stats.size(); ++i) {
+		const CACHE_STAT& s = cache_stats.at(i);
+		if (i == 0) { cout << "index cache:\t"; }
+		else { cout << "read " << i << " cache:\t"; }
+		cout << s.size << " sequences, " << s.hits << " hits, " << s.misses << " misses";
+		if (s.hits + s.misses) {
+			cout << " (" << (100.0 * s.hits) / (s.hits + s.misses) << "% hits)";
+		}
+		cout << endl;
+	}
 }
 
 /* exports data into a user friendly tabular format
@@ -690,7 +1041,7 @@ void Read_counter::write_table() {
 	for (umsi_it it = translated->begin(); it != translated->end(); ++it) {
 		record = it->first;
 		chunks = split_string(record, HASH_SEP);
-		ctr[chunks.at(0)][chunks.at(1)] = it->second;
+		ctr[chunks.at(0)][chunks.at(1)] = with_umis ? (*molecules)[record].size() : it->second;
 	}
 
 	// open output file
@@ -745,8 +1096,10 @@ void Read_counter::write_raw_counts() {
 	for (umsi_it iti = translated->begin(); iti != translated->end(); ++iti) {
 		string rec = iti->first;
 		rec.replace(rec.find(HASH_SEP),1,OUTPUT_SEP);
-		if (out.is_open()) { out << rec << OUTPUT_SEP << iti->second << endl; }
-		else { cout << rec << OUTPUT_SEP << iti->second << endl; }
+		rec += OUTPUT_SEP + to_string(iti->second);
+		if (with_umis) { rec += OUTPUT_SEP + to_string((*molecules)[iti->first].size()); }
+		if (out.is_open()) { out << rec << endl; }
+		else { cout << rec << endl; }
 	}
 	
 	if (out.is_open()) { out.close(); }
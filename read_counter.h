@@ -9,6 +9,9 @@
 #include <boost/thread.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/unordered_set.hpp>
+#include "seq_lookup.h"
+#include "key_table.h"
+#include "seq_cache.h"
 using namespace std;
 
 typedef boost::unordered::unordered_map<string, uint32_t> umsi;
@@ -20,9 +23,27 @@ typedef boost::unordered::unordered_map<string, string>::iterator umss_it;
 typedef boost::unordered::unordered_set<string> uss;
 typedef boost::unordered::unordered_set<string>::iterator uss_it;
 
+// key -> sorted distinct UMI codes
+typedef boost::unordered::unordered_map<string, vector<uint64_t> > umsv;
+typedef boost::unordered::unordered_map<string, vector<uint64_t> >::iterator umsv_it;
+
 typedef boost::unordered::unordered_map< string, umsi> multi_hash;
 typedef boost::unordered::unordered_map< string, umsi>::iterator mh_it;
 
+// translated counts of a counting thread
+typedef struct count_part {
+	umsi translated;
+	umsv molecules;
+	vector<umsi> stats;	// per read
+} COUNT_PART;
+
+// use of a shared lookup cache over a run
+typedef struct cache_stat {
+	size_t size;
+	uint64_t hits;
+	uint64_t misses;
+} CACHE_STAT;
+
 enum ERRORS {
 	RCEC_COLLAPSER_CORRUPT_RECORD		= 2,
 	RCEC_COUNTER_CORRUPT_RECORD		= 3,
@@ -87,16 +108,20 @@ class Read_counter {
 
 		void set_min_qual(uint8_t n);
 		void set_max_lq_bases(uint8_t n);
+		void set_extra_cols(uint8_t n);
+		void set_with_umis(bool i);
+		void set_collapsed_input(bool i);
+		void set_edit_reads(bool i);
 
 		void print_params();
 		void count(bool in_z);
 		void write_raw_counts();
 		void write_table();
 		void write_raw_stats();
+		void print_stats();
 
 	private:
 		boost::mutex collapse_mtx;
-		boost::mutex counter_mtx;
 		fstream in;
 
 		uint8_t index_mm;
@@ -104,6 +129,18 @@ class Read_counter {
 
 		uint8_t min_qual;
 		uint8_t max_lq_bases;
+
+		// extra columns after each read's quality string e.g. strand
+		uint8_t extra_cols;
+
+		// the first extra column is a UMI, unique molecules are counted
+		bool with_umis;
+
+		// input is already collapsed by extract_reads --collapse
+		bool collapsed_input;
+
+		// --rmm counts indels as well as mismatches
+		bool edit_reads;
 		
 		char* infile;
 		char* outfile;
@@ -141,10 +178,22 @@ class Read_counter {
 		umsi* counts_hash;
 		umsi* translated;
 
+		umsv* umis_hash;	// UMIs per counts_hash key
+		umsv* molecules;	// UMIs per translated key
+
+		// collapsed entries being counted, next one to claim
+		vector<const umsi::value_type*> snapshot;
+		size_t next_entry;
+
 		umsi* stats_idx;
 		vector<umsi*> stats_r;
+
+		// index cache, then one per read
+		vector<CACHE_STAT> cache_stats;
  
 		umss load_mapping(char* fn, bool rc);
+		Seq_lookup* build_lookup(umss& mapping, uint8_t mm, bool edits);
+		CACHE_STAT cache_stat(const Seq_cache& c);
 
 		void set_defaults();
 
@@ -155,18 +204,32 @@ class Read_counter {
 		template<class T>
 		void collapse_reads(
 				T& in,
-				umss& sample_map
+				Seq_cache& samples
 				);
 		
-		void count_reads(vector<umss>& maps);
+		template<class T>
+		void load_collapsed(
+				T& in,
+				Seq_cache& samples
+				);
+
+		void count_reads(vector<Seq_cache*>& lookups, COUNT_PART& part);
+		void merge_parts(COUNT_PART& into, COUNT_PART& from);
+
+		bool pack_record(
+				const string& l,
+				const vector<size_t>& from,
+				const vector<size_t>& to,
+				uint8_t nr,
+				const vector<bool>& fails,
+				uint32_t code,
+				PACKED_KEY& k);
+		string unpack_key(const PACKED_KEY& k, const Seq_lookup& samples);
 
 		string match_with_helper(
-				string& seq,      
-				vector<string>& lookup, 
-				umss& mapping,
-				umss& tmm,
-				uint8_t mm,
-				string& tag);
+				const string& seq,      
+				Seq_cache& cache,
+				const string& tag);
 };
 #endif //__READ_COUNTER_H__
 
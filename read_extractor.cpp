@@ -1,6 +1,8 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <cctype>
 #include "fastq_seq.h"
 #include "utils.h"
 #include <pcrecpp.h>
@@ -39,25 +41,74 @@ Read_extractor::Read_extractor(
 	mm_r = true;
 	mm_s = true;
 
+	ed_l = 0;
+	ed_r = 0;
+
+	n_reads = 0;
+	n_valid = 0;
+	n_rescued = 0;
+	n_reverse = 0;
+	n_filtered = 0;
+	with_indels = false;
+	split_rejected = false;
+	n_rejected.assign(RJ_N, 0);
+
+	smap = NULL;
+	index_mm = 1;
+	idxrc = false;
+	undef_tag = "undef";
+
 	OUTPUT_SEP = "\t";
 
 	with_valid = false;
 	with_rejected = false;
 	fastq_out = false;
+	both_strands = false;
+
+	collapsed = false;
+	min_qual = 20;
+	max_lq_bases = 5;
+	fail_tag = "Q_FAIL";
 
 	if (out_fn != NULL) { with_valid = true; }
 	if (rej_fn != NULL) { with_rejected = true; }
 }
 
-Read_extractor::~Read_extractor() {}
+/* destructor
+ * cleans up the compiled patterns and output sinks */
+Read_extractor::~Read_extractor() {
+	for (size_t i = 0; i < designs.size(); ++i) {
+		delete(designs.at(i).re);
+		delete(designs.at(i).re_rc);
+		delete(designs.at(i).out);
+		for (size_t k = 0; k < designs.at(i).sample_outs.size(); ++k) {
+			delete(designs.at(i).sample_outs.at(k));
+		}
+	}
+	for (size_t i = 0; i < rej_sinks.size(); ++i) {
+		delete(rej_sinks.at(i));
+	}
+}
 
 /* setters for various private fields */
 void Read_extractor::set_with_valid(bool v) { with_valid = v; }
 
 void Read_extractor::set_with_rejected(bool r) { with_rejected = r; }
 
+void Read_extractor::set_split_rejected(bool s) { split_rejected = s; }
+
 void Read_extractor::set_fastq_out(bool f) { fastq_out = f; }
 
+void Read_extractor::set_both_strands(bool b) { both_strands = b; }
+
+void Read_extractor::set_collapsed(bool c) { collapsed = c; }
+
+void Read_extractor::set_min_qual(uint8_t n) { min_qual = n; }
+
+void Read_extractor::set_max_lq_bases(uint8_t n) { max_lq_bases = n; }
+
+void Read_extractor::set_fail_tag(const string& t) { fail_tag = t; }
+
 void Read_extractor::set_pat_l(const string& s) { pat_l = s; }
 		
 void Read_extractor::set_pat_r(const string& s) { pat_r = s; }
@@ -92,6 +143,8 @@ void Read_extractor::set_spacer(const string& s, size_t p) {
 	spacers.at(p) = s;
 }
 
+void Read_extractor::set_umis(const vector<string>& specs) { umi_specs = specs; }
+
 void Read_extractor::set_load_factor(uint32_t i) { load_factor = i; }
 		
 void Read_extractor::set_n_threads(uint8_t i) { n_threads = i; }
@@ -102,6 +155,12 @@ void Read_extractor::set_mm_r(bool m) { mm_r = m; }
 
 void Read_extractor::set_mm_s(bool m) { mm_s = m; }
 
+void Read_extractor::set_ed_l(uint8_t n) { ed_l = n; }
+
+void Read_extractor::set_ed_r(uint8_t n) { ed_r = n; }
+
+void Read_extractor::set_ed_s(const vector<uint8_t>& n) { ed_s = n; }
+
 void Read_extractor::set_output_sep(const string& sep) { OUTPUT_SEP = sep; }
 
 /* prijnt current parameters */
@@ -111,38 +170,79 @@ void Read_extractor::print_params() {
 	cout << endl;
 
 	cout << "Output:\n";
-	if (with_valid) {
+	if (with_valid && designs.empty()) {
 		cout << "Accept:\t";
 		if (outfile) { cout << outfile; } else { cout << "stdout"; } 
 		cout << endl;
+	}
+	if (with_valid) {
 		cout << "FASTQ output:\t" << fastq_out << endl;
+		cout << "Collapsed:\t" << collapsed << endl;
+	}
+	if (with_valid && collapsed) {
+		cout << "Min quality:\t" << +min_qual << endl;
+		cout << "Max lq_bases:\t" << +max_lq_bases << endl;
+		cout << "fail tag:\t" << fail_tag << endl;
+	}
+	cout << "Both strands:\t" << both_strands << endl;
+	if (smap) {
+		cout << "Sample map:\t" << smap << "\t" << samples.size() << " samples" << endl;
+		cout << "Index mismatches:\t" << +index_mm << endl;
+		cout << "Index revcom:\t" << idxrc << endl;
 	}
 	
 	if (with_rejected) {
 		cout << "Reject\t";
 		if (rejected) { cout << rejected; } else { cout << "stdout"; } 
 		cout << endl;
+		cout << "Split by reason:\t" << split_rejected << endl;
 	}
 	cout << endl;
 
-	cout << "anchors	sequence	mismatch" << endl;
-	cout << "L:	" << pat_l << "\t" << mm_l << endl;
-	cout << "R:	" << pat_r << "\t" << mm_r << endl;
-	cout << endl;
-	cout << "ROI#	Min	Max" << endl;	
-	for (size_t i = 0; i < roi_min.size(); ++i) {
-		cout << i + 1 << "\t" << roi_min.at(i) << "\t" << roi_max.at(i) << endl;
+	// the command line layout unless designs were loaded from a file
+	vector<ER_DESIGN> ds = designs;
+	if (ds.empty()) {
+		ER_DESIGN d;
+		d.pat_l = pat_l;
+		d.pat_r = pat_r;
+		d.roi_min = roi_min;
+		d.roi_max = roi_max;
+		d.spacers = spacers;
+		d.umi_specs = umi_specs;
+		ds.push_back(d);
 	}
 
-	cout << endl;
-	if (spacers.size() > 0) {
-		cout << "spacer	sequence" << endl;	
-		for (size_t i = 0; i < spacers.size(); ++i) {
-			cout << i + 1 << "\t" << spacers.at(i) << endl;
+	for (size_t n = 0; n < ds.size(); ++n) {
+		const ER_DESIGN& d = ds.at(n);
+		if (!designs.empty()) {
+			cout << "Design:\t" << d.name << "\t" << d.out->fn << endl;
 		}
+
+		cout << "anchors	sequence	mismatch	edits" << endl;
+		cout << "L:	" << d.pat_l << "\t" << mm_l << "\t" << +ed_l << endl;
+		cout << "R:	" << d.pat_r << "\t" << mm_r << "\t" << +ed_r << endl;
 		cout << endl;
-		cout << "spacer mismmach:\t" << mm_s << endl;
+		if (!d.umi_specs.empty()) {
+			cout << "UMI:";
+			for (size_t i = 0; i < d.umi_specs.size(); ++i) { cout << "\t" << d.umi_specs.at(i); }
+			cout << endl;
+		}
+		cout << "ROI#	Min	Max" << endl;	
+		for (size_t i = 0; i < d.roi_min.size(); ++i) {
+			cout << i + 1 << "\t" << d.roi_min.at(i) << "\t" << d.roi_max.at(i) << endl;
+		}
+
 		cout << endl;
+		if (d.spacers.size() > 0) {
+			cout << "spacer	sequence	edits" << endl;	
+			for (size_t i = 0; i < d.spacers.size(); ++i) {
+				cout << i + 1 << "\t" << d.spacers.at(i) << "\t";
+				cout << ((i < ed_s.size()) ? +ed_s.at(i) : 0) << endl;
+			}
+			cout << endl;
+			cout << "spacer mismmach:\t" << mm_s << endl;
+			cout << endl;
+		}
 	}
 
 	cout << "Output sep:\t\"" << OUTPUT_SEP << "\"" << endl;
@@ -151,53 +251,890 @@ void Read_extractor::print_params() {
 
 }
 
+/* print extraction counts, call after extract() */
+void Read_extractor::print_stats() {
+	cout << endl;
+	cout << "Reads:\t" << n_reads << endl;
+	cout << "Valid:\t" << n_valid << endl;
+	if (with_indels) {
+		cout << "Rescued by indel tolerance:\t" << n_rescued << endl;
+	}
+	if (both_strands) {
+		cout << "Reverse strand:\t" << n_reverse << endl;
+	}
+	cout << "Prefilter pass:\t" << n_reads - n_filtered << endl;
+	cout << "Prefilter fail:\t" << n_filtered << endl;
+	cout << "Prefilter q:\t" << +filter.get_q() << "\t" << filter.get_n_seeds() << " seeds" << endl;
+
+	if (designs.size() > 1) {
+		cout << endl;
+		cout << "design	valid	rescued	reverse" << endl;
+		for (size_t i = 0; i < designs.size(); ++i) {
+			cout << designs.at(i).name << "\t" << designs.at(i).n_valid;
+			cout << "\t" << designs.at(i).n_rescued;
+			cout << "\t" << designs.at(i).n_reverse << endl;
+		}
+	}
+
+	cout << endl;
+	cout << "rejected	reads" << endl;
+	for (size_t i = 0; i < RJ_N; ++i) {
+		cout << RE_REJECT_TAGS[i] << "\t" << n_rejected.at(i) << endl;
+	}
+
+	if (smap) {
+		cout << endl;
+		cout << "sample	valid" << endl;
+		for (size_t i = 0; i < samples.size(); ++i) {
+			cout << samples.get_id(i) << "\t" << n_sample.at(i) << endl;
+		}
+		cout << undef_tag << "\t" << n_sample.back() << endl;
+	}
+}
+
+/* counts mismatches of a pattern placed at a position in a sequence
+ * 'x' in the pattern matches anything
+ * arguments:
+ * 	pattern
+ * 	sequence
+ * 	position in sequence
+ * 	mismatches allowed, counting stops past this
+ * 	*/
+static uint16_t count_mismatches(const string& pat, const string& s, size_t p, uint16_t limit) {
+	uint16_t res = 0;
+	for (size_t i = 0; i < pat.length(); ++i) {
+		if ((pat[i] != 'x') && (pat[i] != s[p + i])) {
+			if (++res > limit) { break; }
+		}
+	}
+	return res;
+}
+
+/* parses the UMIs of a design and turns them into 'x' positions of the
+ * elements they are next to, call before the patterns are built
+ * a UMI is given as <element><side><length>: the element is l, r or s<n>
+ * (spacer n from 1), the side + (after) or - (before) e.g. l+8 or s1-6
+ * arguments:
+ * 	design
+ * 	*/
+void Read_extractor::apply_umis(ER_DESIGN& d) {
+	d.umis.clear();
+
+	for (size_t i = 0; i < d.umi_specs.size(); ++i) {
+		const string& spec = d.umi_specs.at(i);
+		size_t p = 1;
+		while ((p < spec.length()) && isdigit(spec[p])) { p++; }
+
+		ER_UMI u;
+		u.elem = spec.empty() ? 0 : spec[0];
+		u.spacer = (u.elem == 's') ? atoi(spec.substr(1, p - 1).c_str()) - 1 : 0;
+		u.after = (p < spec.length()) && (spec[p] == '+');
+		u.len = (p < spec.length()) ? atoi(spec.substr(p + 1).c_str()) : 0;
+
+		bool ok = 	((u.elem == 'l') && (p == 1)) ||
+				((u.elem == 'r') && (p == 1)) ||
+				((u.elem == 's') && (p > 1) && (u.spacer < d.spacers.size()));
+		ok = ok && (p < spec.length()) && ((spec[p] == '+') || (spec[p] == '-')) && (u.len > 0);
+
+		// one UMI per side of an element
+		for (size_t j = 0; j < d.umis.size(); ++j) {
+			const ER_UMI& v = d.umis.at(j);
+			if ((v.elem == u.elem) && (v.spacer == u.spacer) && (v.after == u.after)) { ok = false; }
+		}
+
+		if (!ok) {
+			report_error(__FILE__, __func__, RE_BAD_UMI + ": " + spec);
+			exit(REEC_BAD_UMI);
+		}
+		d.umis.push_back(u);
+	}
+
+	// place every UMI relative to the ROI boundary next to its element
+	for (size_t i = 0; i < d.umis.size(); ++i) {
+		ER_UMI& u = d.umis.at(i);
+		int32_t before = 0, after = 0;
+		for (size_t j = 0; j < d.umis.size(); ++j) {
+			const ER_UMI& v = d.umis.at(j);
+			if ((v.elem != u.elem) || (v.spacer != u.spacer)) { continue; }
+			if (v.after) { after = v.len; } else { before = v.len; }
+		}
+
+		switch (u.elem) {
+			case 'l':
+				u.roi = 0;
+				u.from_end = false;
+				u.offset = u.after ? -after : -(after + (int32_t) d.pat_l.length() + before);
+				break;
+			case 'r':
+				u.roi = d.roi_min.size() - 1;
+				u.from_end = true;
+				u.offset = u.after ? before + (int32_t) d.pat_r.length() : 0;
+				break;
+			case 's':
+				u.roi = u.after ? u.spacer + 1 : u.spacer;
+				u.from_end = !u.after;
+				u.offset = u.after ? -after : 0;
+				break;
+		}
+	}
+
+	for (size_t i = 0; i < d.umis.size(); ++i) {
+		const ER_UMI& u = d.umis.at(i);
+		string& e = (u.elem == 'l') ? d.pat_l : ((u.elem == 'r') ? d.pat_r : d.spacers.at(u.spacer));
+		string x(u.len, 'x');
+		e = u.after ? e + x : x + e;
+	}
+}
+
+/* cuts the UMIs of a design out of a matched read, positions beyond an
+ * anchor are only exact if the anchor has no indels and are kept inside
+ * the read
+ * arguments:
+ * 	design
+ * 	sequence as read
+ * 	ROI starts and sequences in forward orientation
+ * 	boolean read matched on the reverse strand
+ * 	string receiving the concatenated UMIs
+ * 	*/
+void Read_extractor::cut_umis(
+		const ER_DESIGN& d,
+		const string& s,
+		const vector<size_t>& pos,
+		const vector<string>& grp,
+		bool rc,
+		string& umi) {
+
+	umi.clear();
+	int64_t sl = s.length();
+	for (size_t i = 0; i < d.umis.size(); ++i) {
+		const ER_UMI& u = d.umis.at(i);
+		int64_t st = pos.at(u.roi) + u.offset;
+		if (u.from_end) { st += grp.at(u.roi).length(); }
+		st = max((int64_t) 0, min(st, sl - u.len));
+
+		if (rc) {
+			umi += seq_revcom(s.substr(max((int64_t) 0, sl - st - u.len), u.len));
+		} else {
+			umi += s.substr(st, u.len);
+		}
+	}
+}
+
+/* reverse complements an anchor or spacer keeping the 'x' wildcards
+ * arguments:
+ * 	pattern
+ * 	*/
+static string pattern_revcom(const string& pat) {
+	string res = seq_revcom(pat);
+	replace_string_in_place(res, "X", "x");
+	return res;
+}
+
+/* builds the layouts used by the edit distance matcher from the
+ * anchors, spacers and their allowed edits, the reverse strand layout
+ * is the forward one read backwards with every element reverse complemented
+ * arguments:
+ * 	design
+ * 	*/
+void Read_extractor::build_layout(ER_DESIGN& d) {
+	ER_LAYOUT& layout = d.layout;
+	layout.elems.clear();
+	layout.roi_min = d.roi_min;
+	layout.roi_max = d.roi_max;
+
+	vector<string> seqs;
+	vector<uint8_t> eds;
+	vector<bool> mms;
+
+	seqs.push_back(d.pat_l);
+	eds.push_back(ed_l);
+	mms.push_back(mm_l);
+
+	// ROIs without spacers are simply adjacent
+	for (size_t i = 0; i + 1 < d.roi_min.size(); ++i) {
+		seqs.push_back((i < d.spacers.size()) ? d.spacers.at(i) : "");
+		eds.push_back((i < ed_s.size()) ? ed_s.at(i) : 0);
+		mms.push_back(mm_s);
+	}
+
+	seqs.push_back(d.pat_r);
+	eds.push_back(ed_r);
+	mms.push_back(mm_r);
+
+	for (size_t i = 0; i < seqs.size(); ++i) {
+		ER_ELEMENT e;
+		e.seq = seqs.at(i);
+		e.ed = eds.at(i);
+		e.mm = mms.at(i);
+
+		if (e.ed > 0) {
+			if (e.seq.length() > 64) {
+				report_error(__FILE__, __func__, RE_BAD_PATTERN + ": " + e.seq);
+				exit(REEC_BAD_PATTERN);
+			}
+			with_indels = true;
+		}
+
+		myers_compile(e.seq, e.pat);
+		layout.elems.push_back(e);
+	}
+
+	if (!both_strands) { return; }
+
+	ER_LAYOUT& rc = d.layout_rc;
+	rc.elems.assign(layout.elems.rbegin(), layout.elems.rend());
+	rc.roi_min.assign(layout.roi_min.rbegin(), layout.roi_min.rend());
+	rc.roi_max.assign(layout.roi_max.rbegin(), layout.roi_max.rend());
+	for (size_t i = 0; i < rc.elems.size(); ++i) {
+		rc.elems.at(i).seq = pattern_revcom(rc.elems.at(i).seq);
+		myers_compile(rc.elems.at(i).seq, rc.elems.at(i).pat);
+	}
+}
+
+/* finds the best placement of an anchor or spacer starting within a window
+ * ties go to the rightmost start, mimicking the greedy ROI of the regex
+ * arguments:
+ * 	element to find
+ * 	sequence
+ * 	first and last allowed start
+ * 	scratch vector for the edit distance scores
+ * 	start and end of the placement found
+ * 	*/
+bool Read_extractor::find_element(
+		const ER_ELEMENT& e,
+		const string& s,
+		size_t lo,
+		size_t hi,
+		vector<uint16_t>& scores,
+		size_t& start,
+		size_t& end) {
+
+	size_t m = e.seq.length();
+	int best = -1;
+
+	for (size_t st = lo; st <= hi; ++st) {
+		uint16_t d = 0;
+		size_t en = st + m;
+
+		if (e.ed == 0) {
+			// substitutions only
+			if (st + m > s.length()) { break; }
+			d = count_mismatches(e.seq, s, st, e.mm ? 1 : 0);
+			if (d > (e.mm ? 1 : 0)) { continue; }
+		} else {
+			// alignment anchored at st, free end
+			size_t n = min(s.length() - st, m + e.ed);
+			d = m;
+			en = st;
+			if (n > 0) {
+				myers_scan(e.pat, s.data() + st, n, true, scores);
+				for (size_t j = 0; j < n; ++j) {
+					if (scores[j] < d) {
+						d = scores[j];
+						en = st + j + 1;
+					}
+				}
+			}
+			if (d > e.ed) { continue; }
+		}
+
+		if ((best < 0) || (d <= best)) {
+			best = d;
+			start = st;
+			end = en;
+		}
+	}
+	return best >= 0;
+}
+
+/* matches a read against a layout allowing edits in anchors and spacers
+ * on failure reports how many elements the best attempt placed and where
+ * the last of them ended, see classify_reject()
+ * arguments:
+ * 	layout
+ * 	sequence
+ * 	vectors receiving ROI positions and lengths
+ * 	scratch vector for the edit distance scores
+ * 	number of elements placed and end of the last one
+ * 	*/
+bool Read_extractor::match_layout(
+		const ER_LAYOUT& lay,
+		const string& s,
+		vector<size_t>& pos,
+		vector<size_t>& len,
+		vector<uint16_t>& scores,
+		size_t& reached,
+		size_t& at) {
+
+	const ER_ELEMENT& left = lay.elems.front();
+	size_t sl = s.length();
+	reached = 0;
+	at = 0;
+
+	// candidate ends of the left anchor as (score, end), best first
+	vector<pair<uint16_t, size_t> > cands;
+	if (left.seq.empty()) {
+		for (size_t p = 0; p <= sl; ++p) { cands.push_back(make_pair(0, p)); }
+	} else if (left.ed == 0) {
+		size_t m = left.seq.length();
+		for (size_t p = 0; p + m <= sl; ++p) {
+			uint16_t d = count_mismatches(left.seq, s, p, left.mm ? 1 : 0);
+			if (d <= (left.mm ? 1 : 0)) { cands.push_back(make_pair(d, p + m)); }
+		}
+	} else {
+		myers_scan(left.pat, s.data(), sl, false, scores);
+		for (size_t j = 0; j < sl; ++j) {
+			if (scores[j] <= left.ed) { cands.push_back(make_pair(scores[j], j + 1)); }
+		}
+	}
+	sort(cands.begin(), cands.end());
+
+	for (size_t c = 0; c < cands.size(); ++c) {
+		size_t p = cands.at(c).second;
+		bool ok = true;
+
+		// place each ROI and the element following it
+		for (size_t r = 0; r < lay.roi_min.size(); ++r) {
+			const ER_ELEMENT& next = lay.elems.at(r + 1);
+			size_t lo = p + lay.roi_min.at(r);
+			size_t hi = min(p + lay.roi_max.at(r), sl);
+
+			size_t st, en;
+			if (	(lo > hi) ||
+				(!next.seq.empty() && !find_element(next, s, lo, hi, scores, st, en))) {
+				// the first attempt getting furthest is the one reported
+				if (r + 1 > reached) {
+					reached = r + 1;
+					at = p;
+				}
+				ok = false;
+				break;
+			}
+
+			pos.at(r) = p;
+			if (next.seq.empty()) {
+				len.at(r) = hi - p;
+				p = hi;
+				continue;
+			}
+
+			len.at(r) = st - p;
+			p = en;
+		}
+		if (ok) { return true; }
+	}
+	return false;
+}
+
+/* layout number k as used by the prefilter, reverse strand layouts
+ * follow the forward ones
+ * arguments:
+ * 	layout number
+ * 	*/
+const ER_LAYOUT& Read_extractor::layout_of(size_t k) const {
+	const ER_DESIGN& d = designs.at(k % designs.size());
+	return (k >= designs.size()) ? d.layout_rc : d.layout;
+}
+
+/* names the reason a layout did not match from how far match_layout() got:
+ * the element it could not place is looked for anywhere downstream, if it
+ * is there the ROI before it was out of range
+ * arguments:
+ * 	layout
+ * 	sequence
+ * 	number of elements placed and end of the last one
+ * 	scratch vector for the edit distance scores
+ * 	*/
+uint8_t Read_extractor::classify_reject(
+		const ER_LAYOUT& lay,
+		const string& s,
+		size_t reached,
+		size_t at,
+		vector<uint16_t>& scores) {
+
+	if (reached == 0) { return RJ_NO_LEFT; }
+
+	const ER_ELEMENT& next = lay.elems.at(reached);
+	size_t st, en;
+	if (next.seq.empty() || find_element(next, s, at, s.length(), scores, st, en)) {
+		return RJ_ROI_LENGTH;
+	}
+	return (reached + 1 == lay.elems.size()) ? RJ_NO_RIGHT : RJ_SPACER;
+}
+
+/* loads design definitions from a file, one design per line with the
+ * tab delimited fields:
+ * 	name, left anchor, right anchor, ROI ranges, spacers, output file
+ * 	and optionally UMIs (comma separated, see apply_umis)
+ * ROI ranges are given as min-max, several ranges and spacers are comma
+ * separated, '-' stands for an empty anchor or no spacers and lines
+ * starting with '#' are skipped
+ * arguments:
+ * 	filename
+ * 	*/
+void Read_extractor::load_designs(char* fn) {
+	string line;
+	ifstream in;
+	attach_stream<ifstream>(fn, in, std::ios_base::in);
+
+	while (getline(in, line)) {
+		if (line.empty() || (line.at(0) == '#')) { continue; }
+
+		vector<string> parts = split_string(line, "\t");
+		bool ok = ((parts.size() == 6) || (parts.size() == 7)) && !parts.at(5).empty();
+
+		ER_DESIGN d;
+		d.umi_specs = umi_specs;
+		if (ok) {
+			d.name = parts.at(0);
+			d.pat_l = (parts.at(1) == "-") ? "" : parts.at(1);
+			d.pat_r = (parts.at(2) == "-") ? "" : parts.at(2);
+
+			vector<string> rois = split_string(parts.at(3), ",");
+			for (size_t i = 0; i < rois.size(); ++i) {
+				vector<string> range = split_string(rois.at(i), "-");
+				if (range.size() != 2) { ok = false; break; }
+				d.roi_min.push_back(atoi(range.at(0).c_str()));
+				d.roi_max.push_back(atoi(range.at(1).c_str()));
+				if (d.roi_min.back() > d.roi_max.back()) { ok = false; }
+			}
+
+			if (!parts.at(4).empty() && (parts.at(4) != "-")) {
+				d.spacers = split_string(parts.at(4), ",");
+			}
+
+			if ((parts.size() == 7) && !parts.at(6).empty() && (parts.at(6) != "-")) {
+				d.umi_specs = split_string(parts.at(6), ",");
+			}
+		}
+
+		if (ok) {
+			ok = 	!d.roi_min.empty() &&
+				(d.roi_min.size() <= RE_MAX_ROIS) &&
+				(d.spacers.empty() || (d.spacers.size() == d.roi_min.size() - 1));
+		}
+
+		if (!ok) {
+			report_error(__FILE__, __func__, RE_BAD_DESIGN + ": " + line);
+			exit(REEC_BAD_DESIGN);
+		}
+
+		d.re = NULL;
+		d.re_rc = NULL;
+		d.out = new ER_SINK;
+		d.out->fn = parts.at(5);
+		d.out->z = (d.out->fn.find(".gz") != string::npos);
+		d.n_valid = 0;
+		d.n_rescued = 0;
+		d.n_reverse = 0;
+		designs.push_back(d);
+	}
+	in.close();
+
+	if (designs.empty()) {
+		report_error(__FILE__, __func__, RE_BAD_DESIGN + ": no designs in " + string(fn));
+		exit(REEC_BAD_DESIGN);
+	}
+	with_valid = true;
+}
+
+/* loads the sample map used to route valid reads to per-sample outputs
+ * and precomputes the index neighborhoods
+ * arguments:
+ * 	sample map filename (sample_id<tab>index_sequence)
+ * 	allowed index mismatches
+ * 	reverse complement the indexes
+ * 	*/
+void Read_extractor::load_samples(char* fn, uint8_t mm, bool rc) {
+	smap = fn;
+	index_mm = mm;
+	idxrc = rc;
+	samples.load(fn, "\t", rc);
+	samples.build(mm);
+	n_sample.assign(samples.size() + 1, 0);
+}
+
+/* prepares the designs for extraction: falls back to the command line
+ * layout if no design file was loaded, compiles the patterns and layouts,
+ * opens the outputs and builds the prefilter shared by all designs
+ * arguments:
+ * 	boolean zipped output for the command line design
+ * 	*/
+void Read_extractor::init_designs(bool z_out) {
+	if (designs.empty()) {
+		ER_DESIGN d;
+		d.name = "default";
+		d.pat_l = pat_l;
+		d.pat_r = pat_r;
+		d.roi_min = roi_min;
+		d.roi_max = roi_max;
+		d.spacers = spacers;
+		d.umi_specs = umi_specs;
+		d.out = new ER_SINK;
+		d.out->fn = outfile ? string(outfile) : string();
+		d.out->z = z_out;
+		d.re_rc = NULL;
+		d.n_valid = 0;
+		d.n_rescued = 0;
+		d.n_reverse = 0;
+		designs.push_back(d);
+	}
+
+	with_indels = false;
+	for (size_t i = 0; i < designs.size(); ++i) {
+		ER_DESIGN& d = designs.at(i);
+		apply_umis(d);
+
+		d.re_str = gen_regex_string(
+				d.pat_l, 
+				d.pat_r, 
+				mm_l, 
+				mm_r, 
+				mm_s, 
+				d.roi_min, 
+				d.roi_max, 
+				d.spacers);
+
+		d.re = new pcrecpp::RE(d.re_str);
+		build_layout(d);
+
+		if (with_valid && smap) {
+			if (d.out->fn.empty()) {
+				report_error(__FILE__, __func__, RE_NO_SAMPLE_FILE);
+				exit(REEC_NO_SAMPLE_FILE);
+			}
+			for (size_t k = 0; k < samples.size(); ++k) {
+				d.sample_outs.push_back(new_tagged_sink(d.out, samples.get_id(k)));
+			}
+			d.sample_outs.push_back(new_tagged_sink(d.out, undef_tag));
+		} else if (with_valid) {
+			open_sink(d.out);
+		}
+
+		if (!both_strands) { continue; }
+
+		// on the reverse strand the right anchor comes first
+		vector<string> sp_rc;
+		for (size_t k = d.spacers.size(); k > 0; --k) {
+			sp_rc.push_back(pattern_revcom(d.spacers.at(k - 1)));
+		}
+		vector<uint16_t> min_rc(d.roi_min.rbegin(), d.roi_min.rend());
+		vector<uint16_t> max_rc(d.roi_max.rbegin(), d.roi_max.rend());
+
+		d.re_str_rc = gen_regex_string(
+				pattern_revcom(d.pat_r),
+				pattern_revcom(d.pat_l),
+				mm_r,
+				mm_l,
+				mm_s,
+				min_rc,
+				max_rc,
+				sp_rc);
+
+		d.re_rc = new pcrecpp::RE(d.re_str_rc);
+	}
+
+	// all anchors and spacers of a layout have to be present in a matching read
+	size_t n_layouts = both_strands ? 2*designs.size() : designs.size();
+	for (size_t k = 0; k < n_layouts; ++k) {
+		const ER_LAYOUT& lay = layout_of(k);
+		for (size_t e = 0; e < lay.elems.size(); ++e) {
+			const ER_ELEMENT& el = lay.elems.at(e);
+			filter.add_element(k, el.seq, (el.ed > 0) ? el.ed : (el.mm ? 1 : 0));
+		}
+	}
+	filter.build();
+}
+
+/* opens the file behind a sink, sinks without a filename go to stdout
+ * arguments:
+ * 	sink
+ * 	*/
+void Read_extractor::open_sink(ER_SINK* sink) {
+	sink->written = false;
+	if (!sink->fn.empty()) {
+		attach_stream<ofstream>(
+				const_cast<char*>(sink->fn.c_str()),
+				sink->out,
+				std::ios_base::out | std::ios_base::binary);
+	}
+}
+
+/* creates and opens a sink next to an output, used per sample and per
+ * rejection reason, the tag goes in front of the extension
+ * e.g. lib_A.txt.gz -> lib_A.s1.txt.gz
+ * arguments:
+ * 	output
+ * 	sample id or reason
+ * 	*/
+ER_SINK* Read_extractor::new_tagged_sink(const ER_SINK* out, const string& tag) {
+	ER_SINK* sink = new ER_SINK;
+	size_t base = out->fn.find_last_of("/");
+	size_t dot = out->fn.find(".", (base == string::npos) ? 0 : base + 1);
+
+	sink->fn = out->fn;
+	if (dot == string::npos) {
+		sink->fn += "." + tag;
+	} else {
+		sink->fn.insert(dot, "." + tag);
+	}
+	sink->z = out->z;
+	open_sink(sink);
+	return sink;
+}
+
+/* closes the file behind a sink, compressed files that got no reads
+ * still get an empty gzip member so that they can be read downstream
+ * arguments:
+ * 	sink
+ * 	*/
+void Read_extractor::close_sink(ER_SINK* sink) {
+	if (!sink->out.is_open()) { return; }
+	if (sink->z && !sink->written) { sink->out << compress_string(""); }
+	sink->out.close();
+}
+
+/* compresses a buffer if needed and appends it to a sink
+ * arguments:
+ * 	sink
+ * 	buffer
+ * 	*/
+void Read_extractor::write_sink(ER_SINK* sink, string& buffer) {
+	if (buffer.empty()) { return; }
+	if (sink->z) { buffer = compress_string(buffer); }
+
+	// critical
+	// only this sink is locked
+	sink->mtx.lock();
+	if (sink->out.is_open()) {
+		sink->out << buffer;
+	} else {
+		cout << buffer;
+	}
+	sink->written = true;
+	sink->mtx.unlock();
+	// end critical
+}
+
+/* writes the collapsed tuples of a sink with their counts
+ * arguments:
+ * 	sink
+ * 	*/
+void Read_extractor::write_tally(ER_SINK* sink) {
+	string buffer;
+	for (umsu64_it it = sink->tally.begin(); it != sink->tally.end(); ++it) {
+		buffer += it->first + OUTPUT_SEP + to_string(it->second) + "\n";
+	}
+	sink->tally.clear();
+	write_sink(sink, buffer);
+}
+
+/* runs a compiled pattern on a sequence capturing up to RE_MAX_ROIS groups
+ * arguments:
+ * 	regular expression
+ * 	sequence
+ * 	vector receiving the captured groups
+ * 	number of groups to capture
+ * 	*/
+bool Read_extractor::match_regex(
+		pcrecpp::RE& re,
+		const string& s,
+		vector<string>& grp,
+		size_t n_groups) {
+
+	bool match = false;
+
+	switch (n_groups) {
+		case 1: match =  re.PartialMatch( s, 
+						&grp.at(0)); 
+			break;
+		 	
+		case 2: match =  re.PartialMatch( s, 
+						&grp.at(0), 
+						&grp.at(1));
+			break;
+
+		case 3: match =  re.PartialMatch( s, 
+						&grp.at(0), 
+						&grp.at(1), 
+						&grp.at(2)); 
+			break;
+	
+		case 4: match =  re.PartialMatch( s, 
+						&grp.at(0), 
+						&grp.at(1), 
+						&grp.at(2), 
+						&grp.at(3)); 
+			break;
+	
+		case 5: match =  re.PartialMatch( s, 
+						&grp.at(0), 
+						&grp.at(1), 
+						&grp.at(2), 
+						&grp.at(3), 
+						&grp.at(4)); 
+			break;
+		
+		case 6: match =  re.PartialMatch( s, 
+						&grp.at(0), 
+						&grp.at(1), 
+						&grp.at(2), 
+						&grp.at(3), 
+						&grp.at(4), 
+						&grp.at(5)); 
+			break;
+		
+		case 7: match =  re.PartialMatch( s, 
+						&grp.at(0), 
+						&grp.at(1), 
+						&grp.at(2), 
+						&grp.at(3), 
+						&grp.at(4), 
+						&grp.at(5), 
+						&grp.at(6)); 
+			break;
+		
+		case 8: match =  re.PartialMatch( s, 
+						&grp.at(0), 
+						&grp.at(1), 
+						&grp.at(2), 
+						&grp.at(3), 
+						&grp.at(4), 
+						&grp.at(5),
+						&grp.at(6),
+						&grp.at(7)); 
+			break;
+	
+		case 9: match =  re.PartialMatch( s, 
+						&grp.at(0), 
+						&grp.at(1), 
+						&grp.at(2), 
+						&grp.at(3), 
+						&grp.at(4), 
+						&grp.at(5),
+						&grp.at(6),
+						&grp.at(7),
+						&grp.at(8)); 
+			break;
+	
+	
+		case 10: match =  re.PartialMatch( s, 
+						&grp.at(0), 
+						&grp.at(1), 
+						&grp.at(2), 
+						&grp.at(3), 
+						&grp.at(4), 
+						&grp.at(5), 
+						&grp.at(6),
+						&grp.at(7),
+						&grp.at(8),
+						&grp.at(9)); 
+			break;
+	
+		case 11: match =  re.PartialMatch( s, 
+						&grp.at(0), 
+						&grp.at(1), 
+						&grp.at(2), 
+						&grp.at(3), 
+						&grp.at(4), 
+						&grp.at(5), 
+						&grp.at(6),
+						&grp.at(7),
+						&grp.at(8),
+						&grp.at(9),
+						&grp.at(10)); 
+			break;
+	
+		case 12: match =  re.PartialMatch( s, 
+						&grp.at(0), 
+						&grp.at(1), 
+						&grp.at(2), 
+						&grp.at(3), 
+						&grp.at(4), 
+						&grp.at(5), 
+						&grp.at(6),
+						&grp.at(7),
+						&grp.at(8),
+						&grp.at(9),
+						&grp.at(10),
+						&grp.at(11)); 
+			break;
+	}
+	return match;
+}
+
 /* extracts matching seuence reads
+ * every read goes to the first design it matches, designs are tried
+ * with their patterns first and with the edit distance matcher second,
+ * forward strand before reverse strand
  * parameters:
  * 	input stream
- * 	output stream for matched reads
- * 	output stream for rejected reads
- * 	regular expression
  * 	load factor (uint32_t)
- * 	boolean zipped output
  * 	*/
 template<class T1>
 void Read_extractor::extract_seq_reads(
 		T1& in, 
-		ofstream& out,
-		ofstream& rej,
-		pcrecpp::RE& re, 
-		uint32_t load_factor,
-		bool z_out,
-		bool z_rej) {
+		uint32_t load_factor) {
 
 	vector<Fastq_seq>* seqs = new vector<Fastq_seq>;
 
 	Fastq_seq fq;
 	string uid;
 
-	// maximum number of captured groups
-	// gives us up to 6 rois
-	uint8_t max_groups = 12;
-	vector<string> grp(max_groups);
+	// captured groups
+	vector<string> grp(RE_MAX_ROIS);
+
+	// one output buffer per design and sample, the undefined index is the last sample
+	size_t n_slots = smap ? samples.size() + 1 : 1;
+	vector<string> out_buffers(designs.size()*n_slots);
+
+	// collapsed output, tuples are counted per thread and merged at the end
+	vector<umsu64> tallies(collapsed ? designs.size()*n_slots : 0);
+	string key;
+
+	// one rejected buffer, or one per reason
+	vector<string> rej_buffers(split_rejected ? RJ_N : 1);
+
+	// ROI qualities
+	vector<string> quals(RE_MAX_ROIS);
+
+	// UMIs of the design, concatenated
+	string umi;
+
+	// ROI placement, also filled in by the edit distance matcher
+	vector<size_t> roi_pos(RE_MAX_ROIS);
+	vector<size_t> roi_len(RE_MAX_ROIS);
+	vector<uint16_t> scores;
 
-	// hold the current number of groups to be captured
-	size_t n_groups = roi_min.size();
+	// seed hits of the shared prefilter, a layout is only tried if it passes
+	vector<uint8_t> hits;
+	size_t n_layouts = both_strands ? 2*designs.size() : designs.size();
 
-	string* out_buffer = new string;
-	string* rej_buffer = new string;
+	// per thread counters
+	uint64_t reads = 0;
+	vector<uint64_t> valid(designs.size(), 0);
+	vector<uint64_t> rescued(designs.size(), 0);
+	vector<uint64_t> rev_strand(designs.size(), 0);
+	vector<uint64_t> per_sample(n_slots, 0);
+	vector<uint64_t> rejects(RJ_N, 0);
+	uint64_t filtered = 0;
 
 	while (1) {
 		seqs->clear();
 		seqs->reserve(load_factor);
 		
 		if (with_valid) {
-			out_buffer->clear();
-			out_buffer->reserve(load_factor*1000);
+			for (size_t d = 0; d < out_buffers.size(); ++d) {
+				out_buffers.at(d).clear();
+				out_buffers.at(d).reserve(load_factor*1000/out_buffers.size());
+			}
 		}
 		
 		if (with_rejected) {
-			rej_buffer->clear();
-			rej_buffer->reserve(load_factor*1000);
+			for (size_t r = 0; r < rej_buffers.size(); ++r) {
+				rej_buffers.at(r).clear();
+				rej_buffers.at(r).reserve(load_factor*1000/rej_buffers.size());
+			}
 		}
 		
 		// critical
@@ -224,137 +1161,155 @@ void Read_extractor::extract_seq_reads(
 			
 			uid = seq.get_unique_id();
 			bool match = false;
+			bool rc = false;
+			size_t d = 0;
 
-			switch (n_groups) {
-				case 1: match =  re.PartialMatch( s, 
-								&grp.at(0)); 
-					break;
-				 	
-				case 2: match =  re.PartialMatch( s, 
-								&grp.at(0), 
-								&grp.at(1));
-					break;
+			reads++;
+			filter.scan(s, hits);
+			size_t n_pass = 0;
 
-				case 3: match =  re.PartialMatch( s, 
-								&grp.at(0), 
-								&grp.at(1), 
-								&grp.at(2)); 
-					break;
-			
-				case 4: match =  re.PartialMatch( s, 
-								&grp.at(0), 
-								&grp.at(1), 
-								&grp.at(2), 
-								&grp.at(3)); 
-					break;
-			
-				case 5: match =  re.PartialMatch( s, 
-								&grp.at(0), 
-								&grp.at(1), 
-								&grp.at(2), 
-								&grp.at(3), 
-								&grp.at(4)); 
-					break;
-				
-				case 6: match =  re.PartialMatch( s, 
-								&grp.at(0), 
-								&grp.at(1), 
-								&grp.at(2), 
-								&grp.at(3), 
-								&grp.at(4), 
-								&grp.at(5)); 
-					break;
-				
-				case 7: match =  re.PartialMatch( s, 
-								&grp.at(0), 
-								&grp.at(1), 
-								&grp.at(2), 
-								&grp.at(3), 
-								&grp.at(4), 
-								&grp.at(5), 
-								&grp.at(6)); 
-					break;
-				
-				case 8: match =  re.PartialMatch( s, 
-								&grp.at(0), 
-								&grp.at(1), 
-								&grp.at(2), 
-								&grp.at(3), 
-								&grp.at(4), 
-								&grp.at(5),
-								&grp.at(6),
-								&grp.at(7)); 
-					break;
-			
-				case 9: match =  re.PartialMatch( s, 
-								&grp.at(0), 
-								&grp.at(1), 
-								&grp.at(2), 
-								&grp.at(3), 
-								&grp.at(4), 
-								&grp.at(5),
-								&grp.at(6),
-								&grp.at(7),
-								&grp.at(8)); 
-					break;
-			
-			
-				case 10: match =  re.PartialMatch( s, 
-								&grp.at(0), 
-								&grp.at(1), 
-								&grp.at(2), 
-								&grp.at(3), 
-								&grp.at(4), 
-								&grp.at(5), 
-								&grp.at(6),
-								&grp.at(7),
-								&grp.at(8),
-								&grp.at(9)); 
-					break;
-			
-				case 11: match =  re.PartialMatch( s, 
-								&grp.at(0), 
-								&grp.at(1), 
-								&grp.at(2), 
-								&grp.at(3), 
-								&grp.at(4), 
-								&grp.at(5), 
-								&grp.at(6),
-								&grp.at(7),
-								&grp.at(8),
-								&grp.at(9),
-								&grp.at(10)); 
-					break;
-			
-				case 12: match =  re.PartialMatch( s, 
-								&grp.at(0), 
-								&grp.at(1), 
-								&grp.at(2), 
-								&grp.at(3), 
-								&grp.at(4), 
-								&grp.at(5), 
-								&grp.at(6),
-								&grp.at(7),
-								&grp.at(8),
-								&grp.at(9),
-								&grp.at(10),
-								&grp.at(11)); 
+			// exact patterns first
+			for (size_t k = 0; k < n_layouts; ++k) {
+				if (!filter.passes(k, hits)) { continue; }
+				n_pass++;
+
+				d = k % designs.size();
+				rc = k >= designs.size();
+				ER_DESIGN& ds = designs.at(d);
+
+				if (match_regex(rc ? *ds.re_rc : *ds.re, s, grp, ds.roi_min.size())) {
+					for (size_t g = 0; g < ds.roi_min.size(); ++g) {
+						roi_pos.at(g) = s.find(grp.at(g));
+					}
+					match = true;
 					break;
+				}
+			}
+
+			// then edit distance, reads found this way are rescued by indel tolerance
+			// failed attempts also tell how far a rejected read got
+			size_t reached, at;
+			size_t best_k = n_layouts;
+			size_t best_reached = 0;
+			size_t best_at = 0;
+
+			if (!match && with_indels) {
+				for (size_t k = 0; k < n_layouts; ++k) {
+					if (!filter.passes(k, hits)) { continue; }
+
+					d = k % designs.size();
+					rc = k >= designs.size();
+					ER_DESIGN& ds = designs.at(d);
+
+					if (match_layout(layout_of(k), s, roi_pos, roi_len, scores, reached, at)) {
+						for (size_t g = 0; g < ds.roi_min.size(); ++g) {
+							grp.at(g) = s.substr(roi_pos.at(g), roi_len.at(g));
+						}
+						match = true;
+						rescued.at(d)++;
+						break;
+					}
+
+					if ((best_k == n_layouts) || (reached > best_reached)) {
+						best_k = k;
+						best_reached = reached;
+						best_at = at;
+					}
+				}
+			}
+
+			uint8_t reason = RJ_OTHER;
+			if (!match) {
+				if (n_pass == 0) { filtered++; }
+
+				// the prefilter is only conclusive about the left anchor, other
+				// layouts are run for the reason unless the edit distance pass did
+				bool other = false;
+				for (size_t k = 0; k < n_layouts; ++k) {
+					int miss = filter.first_missing(k, hits);
+					if (miss == 0) {
+						reached = 0;
+						at = 0;
+					} else if (with_indels && (miss < 0)) {
+						continue;
+					} else if (match_layout(layout_of(k), s, roi_pos, roi_len, scores, reached, at)) {
+						other = true;
+						break;
+					}
+
+					if ((best_k == n_layouts) || (reached > best_reached)) {
+						best_k = k;
+						best_reached = reached;
+						best_at = at;
+					}
+				}
+				if (!other) {
+					reason = classify_reject(layout_of(best_k), s, best_reached, best_at, scores);
+				}
 			}
 
 			if (match) {	// found match
+				valid.at(d)++;
+				size_t n_groups = designs.at(d).roi_min.size();
+
+				// route to the sample the index maps to
+				size_t slot = 0;
+				if (smap) {
+					int32_t k = samples.find(seq.get_index());
+					slot = (k < 0) ? samples.size() : k;
+					per_sample.at(slot)++;
+				}
+				string* out_buffer = &out_buffers.at(d*n_slots + slot);
+
+				for (size_t g = 0; g < n_groups; ++g) {
+					quals.at(g) = q.substr(roi_pos.at(g), grp.at(g).length());
+				}
+
+				// reverse strand ROIs are written in forward orientation
+				if (rc) {
+					rev_strand.at(d)++;
+					std::reverse(grp.begin(), grp.begin() + n_groups);
+					std::reverse(quals.begin(), quals.begin() + n_groups);
+					std::reverse(roi_pos.begin(), roi_pos.begin() + n_groups);
+					for (size_t g = 0; g < n_groups; ++g) {
+						grp.at(g) = seq_revcom(grp.at(g));
+						std::reverse(quals.at(g).begin(), quals.at(g).end());
+						roi_pos.at(g) = s.length() - roi_pos.at(g) - grp.at(g).length();
+					}
+				}
+				string strand = rc ? "-" : "+";
+
+				bool with_umi = !designs.at(d).umis.empty();
+				if (with_umi) { cut_umis(designs.at(d), s, roi_pos, grp, rc, umi); }
+
 				// output valid reads if needed
-				if (with_valid) {
+				if (with_valid && collapsed) {
+					// one column per ROI, each checked for quality on its own
+					key = seq.get_index();
+					for (size_t g = 0; g < n_groups; ++g) {
+						key += OUTPUT_SEP;
+						if (seq_qual(quals.at(g), min_qual) > max_lq_bases) { key += fail_tag; }
+						else { key += grp.at(g); }
+					}
+					if (with_umi) { key += OUTPUT_SEP + umi; }
+					if (both_strands) { key += OUTPUT_SEP + strand; }
+					tallies.at(d*n_slots + slot)[key]++;
+				} else if (with_valid) {
 					if (fastq_out) {
 					// output fastq file
-						*out_buffer += seq.get_seq_id() + "\n";
+						// the UMI is appended to the read name
+						string id = seq.get_seq_id();
+						if (with_umi) { id.insert(min(id.find(" "), id.length()), "_" + umi); }
+						*out_buffer += id + "\n";
 						for (size_t g = 0; g < n_groups; ++g) {
 							*out_buffer += grp.at(g);
 						}
-						*out_buffer += "\n+\n";
+						// the strand goes on the separator line
+						*out_buffer += "\n+";
+						if (both_strands) { *out_buffer += strand; }
+						*out_buffer += "\n";
 						for (size_t g = 0; g < n_groups; ++g) {
-							*out_buffer += 
-								q.substr(s.find(grp.at(g)), grp.at(g).length());
+							*out_buffer += quals.at(g);
 						}
 						*out_buffer += "\n";
 					} else {		
@@ -365,82 +1320,112 @@ void Read_extractor::extract_seq_reads(
 								OUTPUT_SEP +
 								grp.at(g) + 
 								OUTPUT_SEP +
-								q.substr(s.find(grp.at(g)), grp.at(g).length());
+								quals.at(g);
 						}
+						if (with_umi) { *out_buffer += OUTPUT_SEP + umi; }
+						if (both_strands) { *out_buffer += OUTPUT_SEP + strand; }
 						*out_buffer += "\n";
 					}
 				}
 			} else {	// no match
 				// output rejected reads if needed
-				if (with_rejected) { *rej_buffer += seq.to_string(); }
+				rejects.at(reason)++;
+				if (with_rejected) { rej_buffers.at(split_rejected ? reason : 0) += seq.to_string(); }
 			}
 		}
 
-		if (z_out) {
-			if (with_valid)		{ *out_buffer = compress_string(*out_buffer); }
-			if (with_rejected)	{ *rej_buffer = compress_string(*rej_buffer); }
-		}
-
-		// critical
-		// write into output streams
-		mtx.lock();
-
+		// write into output sinks
 		if (with_valid) {
-			if (out.is_open()) {
-				out << *out_buffer;
-			} else {
-				cout << *out_buffer;
+			for (size_t d = 0; d < designs.size(); ++d) {
+				if (!smap) {
+					write_sink(designs.at(d).out, out_buffers.at(d));
+					continue;
+				}
+				for (size_t k = 0; k < n_slots; ++k) {
+					write_sink(designs.at(d).sample_outs.at(k), out_buffers.at(d*n_slots + k));
+				}
 			}
 		}
 		
-		if (with_rejected) {
-			if (rej.is_open()) {	
-				rej << *rej_buffer;
-			} else {
-				cout << *out_buffer;
+		for (size_t r = 0; with_rejected && (r < rej_buffers.size()); ++r) {
+			write_sink(rej_sinks.at(r), rej_buffers.at(r));
+		}
+	}
+
+	// merge the collapsed tuples, only the sink is locked
+	for (size_t d = 0; d < tallies.size() / n_slots; ++d) {
+		for (size_t k = 0; k < n_slots; ++k) {
+			ER_SINK* sink = smap ? designs.at(d).sample_outs.at(k) : designs.at(d).out;
+			umsu64& t = tallies.at(d*n_slots + k);
+
+			// critical
+			sink->mtx.lock();
+			for (umsu64_it it = t.begin(); it != t.end(); ++it) {
+				sink->tally[it->first] += it->second;
 			}
+			sink->mtx.unlock();
+			// end critical
 		}
+	}
 
-		mtx.unlock();
-		// end critical
+	// critical
+	// merge the counters
+	mtx.lock();
+	n_reads += reads;
+	for (size_t d = 0; d < designs.size(); ++d) {
+		designs.at(d).n_valid += valid.at(d);
+		designs.at(d).n_rescued += rescued.at(d);
+		designs.at(d).n_reverse += rev_strand.at(d);
+		n_valid += valid.at(d);
+		n_rescued += rescued.at(d);
+		n_reverse += rev_strand.at(d);
+	}
+	for (size_t k = 0; smap && (k < n_slots); ++k) {
+		n_sample.at(k) += per_sample.at(k);
 	}
-	delete(out_buffer);
-	delete(rej_buffer);
+	for (size_t r = 0; r < RJ_N; ++r) {
+		n_rejected.at(r) += rejects.at(r);
+	}
+	n_filtered += filtered;
+	mtx.unlock();
+	// end critical
+
+	delete(seqs);
 }
 
 /* main function to call from a program
  * parameters
  * 	boolean zipped input
  * 	boolean zipped output
+ * 	boolean zipped rejected output
  * 	*/
 void Read_extractor::extract(bool z_in, bool z_out, bool z_rej) {
 	boost::thread_group tgroup;
 
 	ifstream i1;
 	igzstream z1;
-	
-	ofstream out;
-	ofstream rej;
-	
-	if (with_valid && outfile) {
-		attach_stream<ofstream>(outfile, out, std::ios_base::out | std::ios_base::binary); 
-	}
-	
-	if (with_rejected && rejected) {
-		attach_stream<ofstream>(rejected, rej, std::ios_base::out | std::ios_base::binary);
-	}
 
-	re_str = gen_regex_string(
-			pat_l, 
-			pat_r, 
-			mm_l, 
-			mm_r, 
-			mm_s, 
-			roi_min, 
-			roi_max, 
-			spacers);
+	init_designs(z_out);
+	
+	if (with_rejected) {
+		ER_SINK* rej_sink = new ER_SINK;
+		rej_sink->fn = rejected ? string(rejected) : string();
+		rej_sink->z = z_rej;
 
-	pcrecpp::RE re(re_str);
+		if (split_rejected) {
+			if (rej_sink->fn.empty()) {
+				report_error(__FILE__, __func__, RE_NO_REASON_FILE);
+				exit(REEC_NO_REASON_FILE);
+			}
+			for (size_t r = 0; r < RJ_N; ++r) {
+				rej_sinks.push_back(new_tagged_sink(rej_sink, RE_REJECT_TAGS[r]));
+			}
+			delete(rej_sink);
+		} else {
+			open_sink(rej_sink);
+			rej_sinks.push_back(rej_sink);
+		}
+	}
 
 	// everything uncompressed
 	if (!z_in) {	
@@ -450,12 +1435,7 @@ void Read_extractor::extract(bool z_in, bool z_out, bool z_rej) {
 						&Read_extractor::extract_seq_reads<ifstream>, 
 						this, 
 						boost::ref(i1),
-						boost::ref(out),
-						boost::ref(rej),
-						boost::ref(re), 
-						load_factor,
-						z_out,
-						z_rej
+						load_factor
 						)
 					);
 		}
@@ -471,12 +1451,7 @@ void Read_extractor::extract(bool z_in, bool z_out, bool z_rej) {
 						&Read_extractor::extract_seq_reads<igzstream>, 
 						this, 
 						boost::ref(z1),
-						boost::ref(out),
-						boost::ref(rej),
-						boost::ref(re), 
-						load_factor,
-						z_out,
-						z_rej
+						load_factor
 						)
 					);
 		}
@@ -484,6 +1459,15 @@ void Read_extractor::extract(bool z_in, bool z_out, bool z_rej) {
 		if (z1.is_open()) { z1.close(); }
 	}
 
-	if (out.is_open()) { out.close(); }
-	if (rej.is_open()) { rej.close(); }
+	for (size_t d = 0; d < designs.size(); ++d) {
+		if (collapsed) { write_tally(designs.at(d).out); }
+		close_sink(designs.at(d).out);
+		for (size_t k = 0; k < designs.at(d).sample_outs.size(); ++k) {
+			if (collapsed) { write_tally(designs.at(d).sample_outs.at(k)); }
+			close_sink(designs.at(d).sample_outs.at(k));
+		}
+	}
+	for (size_t r = 0; r < rej_sinks.size(); ++r) {
+		close_sink(rej_sinks.at(r));
+	}
 }
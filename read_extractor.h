@@ -6,19 +6,124 @@
 #include <fstream>
 #include <pcrecpp.h>
 #include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
 #include <cstdint>
+#include "utils.h"
+#include "seed_filter.h"
+#include "seq_lookup.h"
 using namespace std;
 
 static string RE_BAD_INDEX =	"Bad index";
+static string RE_BAD_PATTERN =	"Sequence too long for edit distance matching (max 64)";
+static string RE_BAD_DESIGN =	"Bad design definition";
+static string RE_NO_SAMPLE_FILE =	"Per-sample output needs an output filename";
+static string RE_NO_REASON_FILE =	"Per-reason rejected output needs a rejected filename";
+static string RE_BAD_UMI =	"Bad UMI definition";
 
 enum RE_ERRORS {
 	REEC_ROI_BAD_INDEX 	=	1,
-	REEC_SPACER_BAD_INDEX = 	2
+	REEC_SPACER_BAD_INDEX = 	2,
+	REEC_BAD_PATTERN	=	3,
+	REEC_BAD_DESIGN		=	4,
+	REEC_NO_SAMPLE_FILE	=	5,
+	REEC_NO_REASON_FILE	=	6,
+	REEC_BAD_UMI		=	7
 };
 
+// maximum number of ROIs per design (captured groups)
+static const size_t RE_MAX_ROIS = 12;
+
+/* why a read was rejected, in the order the layout is matched */
+enum RE_REJECT {
+	RJ_NO_LEFT	=	0,	// left anchor not found
+	RJ_SPACER	=	1,	// a spacer not found after the preceding ROI
+	RJ_NO_RIGHT	=	2,	// right anchor not found after the last ROI
+	RJ_ROI_LENGTH	=	3,	// all elements present but an ROI out of range
+	RJ_OTHER	=	4,	// substitution layout matches where the pattern does not
+	RJ_N		=	5
+};
+
+static string RE_REJECT_TAGS[RJ_N] = {"no_left", "spacer", "no_right", "roi_length", "other"};
+
+/* an anchor or spacer as seen by the edit distance matcher */
+typedef struct er_element {
+	string			seq;
+	uint8_t			ed;	// allowed edits, 0 falls back to substitutions
+	bool			mm;	// allow one substitution when ed is 0
+	utils::MYERS_PATTERN	pat;
+} ER_ELEMENT;
+
+/* read layout: left anchor, spacers and right anchor in read order
+ * with the ROI length ranges between them */
+typedef struct er_layout {
+	vector<ER_ELEMENT>	elems;
+	vector<uint16_t>	roi_min;
+	vector<uint16_t>	roi_max;
+} ER_LAYOUT;
+
+/* a fixed length UMI next to an anchor or spacer, e.g. l+8 for 8 bases
+ * right after the left anchor. The UMI becomes 'x' positions of that element
+ * so both matchers place it, it is cut out relative to an ROI boundary */
+typedef struct er_umi {
+	char		elem;		// 'l', 'r' or 's'
+	uint8_t		spacer;		// spacer number for 's', from 0
+	bool		after;		// downstream of the element
+	uint16_t	len;
+
+	// where it is in a matched read: start of ROI roi (end if from_end) + offset
+	uint8_t		roi;
+	bool		from_end;
+	int32_t		offset;
+} ER_UMI;
+
+// tuple -> number of reads, for collapsed output
+typedef boost::unordered::unordered_map<string, uint64_t> umsu64;
+typedef boost::unordered::unordered_map<string, uint64_t>::iterator umsu64_it;
+
+/* an output file with its own lock, threads only hold it while writing */
+typedef struct er_sink {
+	string		fn;
+	bool		z;
+	bool		written;
+	ofstream	out;
+	boost::mutex	mtx;
+	umsu64		tally;	// collapsed output, written when closing
+} ER_SINK;
+
+/* one construct: anchors, spacers and ROI ranges plus where its reads go */
+typedef struct er_design {
+	string			name;
+	string			pat_l;
+	string			pat_r;
+	vector<uint16_t>	roi_min;
+	vector<uint16_t>	roi_max;
+	vector<string>		spacers;
+
+	vector<string>		umi_specs;
+	vector<ER_UMI>		umis;
+
+	string			re_str;
+	pcrecpp::RE*		re;
+	ER_LAYOUT		layout;
+
+	// the same construct read on the reverse strand
+	string			re_str_rc;
+	pcrecpp::RE*		re_rc;
+	ER_LAYOUT		layout_rc;
+
+	ER_SINK*		out;
+
+	// one output per sample when demultiplexing, undefined index last
+	vector<ER_SINK*>	sample_outs;
+
+	uint64_t		n_valid;
+	uint64_t		n_rescued;
+	uint64_t		n_reverse;
+} ER_DESIGN;
+
 class Read_extractor {
 	public:
-		Read_extractor(): infile(NULL), outfile(NULL), rejected(NULL){}
+		Read_extractor(): infile(NULL), outfile(NULL), rejected(NULL), smap(NULL) {}
 		Read_extractor(
 				char* in_fn, 
 				const string& p_l, 
@@ -37,10 +142,20 @@ class Read_extractor {
 		void set_mm_l(bool m);
 		void set_mm_r(bool m);
 		void set_mm_s(bool m);
+
+		void set_ed_l(uint8_t n);
+		void set_ed_r(uint8_t n);
+		void set_ed_s(const vector<uint8_t>& n);
 	
 		void set_with_valid(bool v);
 		void set_with_rejected(bool r);
+		void set_split_rejected(bool s);
 		void set_fastq_out(bool f);
+		void set_both_strands(bool b);
+		void set_collapsed(bool c);
+		void set_min_qual(uint8_t n);
+		void set_max_lq_bases(uint8_t n);
+		void set_fail_tag(const string& t);
 
 		void set_roi_mins(vector<uint16_t> i);
 		void set_roi_min(uint16_t i, size_t p);
@@ -50,12 +165,18 @@ class Read_extractor {
 
 		void set_spacer(const string& s, size_t p);
 		void set_spacers(const vector<string>& ss);
+
+		void set_umis(const vector<string>& specs);
 	
 		void set_load_factor(uint32_t i);
 		void set_n_threads(uint8_t i);
 
+		void load_designs(char* fn);
+		void load_samples(char* fn, uint8_t mm, bool rc);
+
 		void extract(bool z_in, bool z_out, bool z_rej);
 		void print_params();
+		void print_stats();
 
 		void set_output_sep(const string& sep);
 
@@ -68,33 +189,112 @@ class Read_extractor {
 		
 		string pat_l;
 		string pat_r;
-		string re_str;
 		string OUTPUT_SEP;
 
 		bool mm_l;
 		bool mm_r;
 		bool mm_s;
 
+		uint8_t ed_l;
+		uint8_t ed_r;
+		vector<uint8_t> ed_s;
+
 		bool fastq_out;
+		bool both_strands;
+
+		// collapsed output: unique (index, ROIs) tuples with read counts,
+		// ROIs with too many low quality bases count as fail_tag
+		bool collapsed;
+		uint8_t min_qual;
+		uint8_t max_lq_bases;
+		string fail_tag;
 
 		bool with_rejected;
 		bool with_valid;
+		bool split_rejected;
 
 		vector<uint16_t> roi_min;
 		vector<uint16_t> roi_max;
 		vector<string> spacers;
+		vector<string> umi_specs;
 
 		uint8_t n_threads;
 		uint32_t load_factor;
+
+		uint64_t n_reads;
+		uint64_t n_valid;
+		uint64_t n_rescued;
+		uint64_t n_reverse;
+		uint64_t n_filtered;	// reads no layout passed the prefilter for
+
+		vector<ER_DESIGN> designs;
+
+		// one rejected output, or one per reason when split
+		vector<ER_SINK*> rej_sinks;
+		vector<uint64_t> n_rejected;
+		Seed_filter filter;
+		bool with_indels;
+
+		// sample demultiplexing
+		char* smap;
+		Seq_lookup samples;
+		uint8_t index_mm;
+		bool idxrc;
+		string undef_tag;
+		vector<uint64_t> n_sample;
+
+		void init_designs(bool z_out);
+		void build_layout(ER_DESIGN& d);
+		void apply_umis(ER_DESIGN& d);
+		void cut_umis(
+				const ER_DESIGN& d,
+				const string& s,
+				const vector<size_t>& pos,
+				const vector<string>& grp,
+				bool rc,
+				string& umi);
+		void open_sink(ER_SINK* sink);
+		ER_SINK* new_tagged_sink(const ER_SINK* out, const string& tag);
+		void close_sink(ER_SINK* sink);
+		void write_sink(ER_SINK* sink, string& buffer);
+		void write_tally(ER_SINK* sink);
+
+		bool match_regex(
+				pcrecpp::RE& re,
+				const string& s,
+				vector<string>& grp,
+				size_t n_groups);
+
+		bool find_element(
+				const ER_ELEMENT& e,
+				const string& s,
+				size_t lo,
+				size_t hi,
+				vector<uint16_t>& scores,
+				size_t& start,
+				size_t& end);
+
+		bool match_layout(
+				const ER_LAYOUT& lay,
+				const string& s,
+				vector<size_t>& pos,
+				vector<size_t>& len,
+				vector<uint16_t>& scores,
+				size_t& reached,
+				size_t& at);
+
+		const ER_LAYOUT& layout_of(size_t k) const;
+
+		uint8_t classify_reject(
+				const ER_LAYOUT& lay,
+				const string& s,
+				size_t reached,
+				size_t at,
+				vector<uint16_t>& scores);
 	
 		template<class T1>
 			void extract_seq_reads(
 				T1& in,
-				ofstream& out,
-				ofstream& rej,
-				pcrecpp::RE& re, 
-				uint32_t load_factor,
-				bool z_out,
-				bool z_rej);
+				uint32_t load_factor);
 };
 #endif //__READ_EXTRACTOR_H__
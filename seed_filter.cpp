@@ -0,0 +1,247 @@
+#include <string>
+#include <vector>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "seed_filter.h"
+using namespace std;
+
+// q-gram length bounds, the upper bound keeps the presence bitmap at 2MB
+static const size_t SF_MIN_Q = 4;
+static const size_t SF_MAX_Q = 12;
+
+// up to this many distinct seeds are looked for directly instead of hashed
+static const size_t SF_MAX_DIRECT_SEEDS = 8;
+
+Seed_filter::Seed_filter() {
+	q = 0;
+	q_mask = 0;
+	direct = false;
+
+	// 2-bit base codes, anything else breaks a q-gram
+	for (size_t i = 0; i < 256; ++i) { code[i] = 4; }
+	code['A'] = 0;
+	code['C'] = 1;
+	code['G'] = 2;
+	code['T'] = 3;
+}
+
+Seed_filter::~Seed_filter() {}
+
+/* registers an element that a layout requires, elements are added in
+ * read order and empty ones only take up their position
+ * arguments:
+ * 	layout number
+ * 	element sequence ('x' is a wildcard)
+ * 	number of errors allowed in the element
+ * 	*/
+void Seed_filter::add_element(uint32_t layout, const string& seq, uint8_t errors) {
+	if (required.size() <= layout) {
+		required.resize(layout + 1);
+		layout_size.resize(layout + 1, 0);
+	}
+	uint32_t rank = layout_size.at(layout)++;
+
+	if (seq.empty()) { return; }
+	elem_layout.push_back(layout);
+	elem_seq.push_back(seq);
+	elem_errors.push_back(errors);
+	elem_rank.push_back(rank);
+}
+
+/* longest stretch without wildcards in seq[from, to)
+ * arguments:
+ * 	sequence
+ * 	range
+ * 	start of the stretch (output)
+ * 	*/
+size_t Seed_filter::longest_run(const string& seq, size_t from, size_t to, size_t& at) const {
+	size_t best = 0;
+	size_t run = 0;
+	at = from;
+	for (size_t i = from; i < to; ++i) {
+		if (code[static_cast<uint8_t>(seq[i])] > 3) {
+			run = 0;
+			continue;
+		}
+		if (++run > best) {
+			best = run;
+			at = i + 1 - run;
+		}
+	}
+	return best;
+}
+
+/* span of seq without leading and trailing wildcards (e.g. UMIs)
+ * arguments:
+ * 	sequence
+ * 	start and length of the span (output)
+ * 	*/
+void Seed_filter::trimmed(const string& seq, size_t& lo, size_t& len) const {
+	size_t hi = seq.length();
+	lo = 0;
+	while ((lo < hi) && (seq[lo] == 'x')) { lo++; }
+	while ((hi > lo) && (seq[hi - 1] == 'x')) { hi--; }
+	len = hi - lo;
+}
+
+/* splits the elements into pieces and indexes one q-gram per piece
+ * takes no arguments
+ * */
+void Seed_filter::build() {
+	seeds.clear();
+	present.clear();
+	seed_strs.clear();
+	seed_ids.clear();
+	for (size_t i = 0; i < required.size(); ++i) { required.at(i).clear(); }
+
+	// an element can only be seeded if all of its pieces can
+	vector<size_t> runs(elem_seq.size(), 0);
+	size_t qq = SF_MAX_Q;
+	for (size_t e = 0; e < elem_seq.size(); ++e) {
+		size_t n_pieces = elem_errors.at(e) + 1;
+		size_t lo, len;
+		trimmed(elem_seq.at(e), lo, len);
+		size_t min_run = len;
+		for (size_t p = 0; p < n_pieces; ++p) {
+			size_t at;
+			min_run = min(min_run, longest_run(elem_seq.at(e), lo + p*len/n_pieces, lo + (p+1)*len/n_pieces, at));
+		}
+		runs.at(e) = min_run;
+		if (min_run >= SF_MIN_Q) { qq = min(qq, min_run); }
+	}
+	q = static_cast<uint8_t>(qq);
+	q_mask = (static_cast<uint64_t>(1) << (2 * q)) - 1;
+	present.assign(((static_cast<uint64_t>(1) << (2 * q)) + 63) / 64, 0);
+
+	for (size_t e = 0; e < elem_seq.size(); ++e) {
+		if (runs.at(e) < q) { continue; }
+
+		size_t n_pieces = elem_errors.at(e) + 1;
+		size_t lo, len;
+		trimmed(elem_seq.at(e), lo, len);
+		for (size_t p = 0; p < n_pieces; ++p) {
+			size_t at;
+			longest_run(elem_seq.at(e), lo + p*len/n_pieces, lo + (p+1)*len/n_pieces, at);
+
+			uint64_t c = 0;
+			for (size_t i = at; i < at + q; ++i) {
+				c = (c << 2) | code[static_cast<uint8_t>(elem_seq.at(e)[i])];
+			}
+
+			vector<uint32_t>& ids = seeds[c];
+			if (find(ids.begin(), ids.end(), e) == ids.end()) { ids.push_back(e); }
+			present[c >> 6] |= static_cast<uint64_t>(1) << (c & 63);
+		}
+		required.at(elem_layout.at(e)).push_back(e);
+	}
+
+	for (umuv_cit it = seeds.begin(); it != seeds.end(); ++it) {
+		string seed(q, 'A');
+		for (size_t i = 0; i < q; ++i) {
+			seed[q - 1 - i] = "ACGT"[(it->first >> (2 * i)) & 3];
+		}
+		seed_strs.push_back(seed);
+		seed_ids.push_back(it->second);
+	}
+	direct = seed_strs.size() <= SF_MAX_DIRECT_SEEDS;
+}
+
+/* looks for a seed anywhere in a read
+ * arguments:
+ * 	sequence
+ * 	seed
+ * 	*/
+bool Seed_filter::find_seed(const string& s, const string& seed) const {
+	size_t n = s.length();
+	if (n < q) { return false; }
+
+	const char* p = s.data();
+	size_t i = 0;
+
+#ifdef __SSE2__
+	// all 16 windows starting in [i, i + 16) at once, one compare per seed base
+	for (; i + 15 + q <= n; i += 16) {
+		int m = 0xFFFF;
+		for (size_t j = 0; (j < q) && m; ++j) {
+			__m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + j));
+			m &= _mm_movemask_epi8(_mm_cmpeq_epi8(w, _mm_set1_epi8(seed[j])));
+		}
+		if (m) { return true; }
+	}
+#endif
+	return s.find(seed, i) != string::npos;
+}
+
+/* scans a read once and flags the elements with a seed hit
+ * arguments:
+ * 	sequence
+ * 	flags per element (output)
+ * 	*/
+void Seed_filter::scan(const string& s, vector<uint8_t>& hits) const {
+	hits.assign(elem_seq.size(), 0);
+	if (seeds.empty()) { return; }
+
+	if (direct) {
+		for (size_t k = 0; k < seed_strs.size(); ++k) {
+			// all elements of this seed already hit
+			bool needed = false;
+			for (size_t e = 0; e < seed_ids[k].size(); ++e) {
+				if (!hits[seed_ids[k][e]]) { needed = true; }
+			}
+			if (!needed || !find_seed(s, seed_strs[k])) { continue; }
+			for (size_t e = 0; e < seed_ids[k].size(); ++e) { hits[seed_ids[k][e]] = 1; }
+		}
+		return;
+	}
+
+	uint64_t c = 0;
+	size_t run = 0;
+	for (size_t i = 0; i < s.length(); ++i) {
+		uint8_t b = code[static_cast<uint8_t>(s[i])];
+		if (b > 3) {
+			run = 0;
+			continue;
+		}
+		c = ((c << 2) | b) & q_mask;
+		if (++run < q) { continue; }
+		if (!(present[c >> 6] & (static_cast<uint64_t>(1) << (c & 63)))) { continue; }
+
+		umuv_cit it = seeds.find(c);
+		for (size_t k = 0; k < it->second.size(); ++k) { hits[it->second[k]] = 1; }
+	}
+}
+
+/* checks whether a layout can still match a scanned read
+ * arguments:
+ * 	layout number
+ * 	flags filled in by scan()
+ * 	*/
+bool Seed_filter::passes(uint32_t layout, const vector<uint8_t>& hits) const {
+	if (layout >= required.size()) { return true; }
+	const vector<uint32_t>& r = required.at(layout);
+	for (size_t i = 0; i < r.size(); ++i) {
+		if (!hits[r[i]]) { return false; }
+	}
+	return true;
+}
+
+/* position in its layout of the first indexed element without a seed hit
+ * returns -1 if the layout passes
+ * arguments:
+ * 	layout number
+ * 	flags filled in by scan()
+ * 	*/
+int Seed_filter::first_missing(uint32_t layout, const vector<uint8_t>& hits) const {
+	if (layout >= required.size()) { return -1; }
+	const vector<uint32_t>& r = required.at(layout);
+	for (size_t i = 0; i < r.size(); ++i) {
+		if (!hits[r[i]]) { return elem_rank[r[i]]; }
+	}
+	return -1;
+}
+
+uint8_t Seed_filter::get_q() const { return q; }
+
+size_t Seed_filter::get_n_seeds() const { return seeds.size(); }
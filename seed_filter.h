@@ -0,0 +1,65 @@
+#ifndef __SEED_FILTER_H__
+#define __SEED_FILTER_H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <boost/unordered_map.hpp>
+using namespace std;
+
+typedef boost::unordered::unordered_map<uint64_t, vector<uint32_t> > umuv;
+typedef boost::unordered::unordered_map<uint64_t, vector<uint32_t> >::const_iterator umuv_cit;
+
+/* Exact q-gram prefilter shared by several read layouts.
+ * An element (anchor or spacer) allowing e errors is split into e+1 pieces,
+ * at least one of which occurs unchanged in any matching read. A q-gram from
+ * every piece is indexed; a read is scanned once and a layout remains a
+ * candidate only if all of its indexed elements have a seed hit.
+ * With few distinct seeds (a single layout) every seed is looked for
+ * directly, 16 read positions at a time with SSE2, stopping at its first
+ * hit; otherwise the read is hashed q-gram by q-gram. */
+class Seed_filter {
+	public:
+		Seed_filter();
+		virtual ~Seed_filter();
+
+		void add_element(uint32_t layout, const string& seq, uint8_t errors);
+		void build();
+
+		void scan(const string& s, vector<uint8_t>& hits) const;
+		bool passes(uint32_t layout, const vector<uint8_t>& hits) const;
+		int first_missing(uint32_t layout, const vector<uint8_t>& hits) const;
+
+		uint8_t get_q() const;
+		size_t get_n_seeds() const;
+
+	private:
+		uint8_t q;
+		uint64_t q_mask;
+
+		// elements as added
+		vector<uint32_t> elem_layout;
+		vector<string> elem_seq;
+		vector<uint8_t> elem_errors;
+		vector<uint32_t> elem_rank;	// position of the element in its layout
+		vector<uint32_t> layout_size;
+
+		// seeded element ids per layout
+		vector< vector<uint32_t> > required;
+
+		// q-gram code -> element ids, with a presence bitmap in front
+		umuv seeds;
+		vector<uint64_t> present;
+
+		// the same seeds as strings for the direct scan
+		bool direct;
+		vector<string> seed_strs;
+		vector< vector<uint32_t> > seed_ids;
+
+		uint8_t code[256];
+
+		size_t longest_run(const string& seq, size_t from, size_t to, size_t& at) const;
+		void trimmed(const string& seq, size_t& lo, size_t& len) const;
+		bool find_seed(const string& s, const string& seed) const;
+};
+#endif //__SEED_FILTER_H__
@@ -0,0 +1,155 @@
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+#include <boost/functional/hash.hpp>
+#include "seq_cache.h"
+using namespace std;
+
+/* hash of a sequence, boost::hash mixed (splitmix64 finalizer) so that
+ * both the shard (top bits) and the slot (low bits) are spread
+ * arguments:
+ * 	sequence
+ * 	*/
+static uint64_t seq_hash(const string& seq) {
+	uint64_t h = boost::hash<string>()(seq);
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	h ^= h >> 31;
+	return h;
+}
+
+/* constructor
+ * arguments:
+ * 	lookup answering the misses
+ * 	*/
+Seq_cache::Seq_cache(const Seq_lookup& l) : lookup(l) {
+	for (size_t i = 0; i < SC_SHARDS; ++i) {
+		shards[i].table = new_table(SC_MIN_SLOTS);
+		shards[i].n = 0;
+		shards[i].hits = 0;
+		shards[i].misses = 0;
+	}
+}
+
+Seq_cache::~Seq_cache() {
+	for (size_t i = 0; i < SC_SHARDS; ++i) {
+		SC_TABLE* t = shards[i].table;
+		for (size_t j = 0; j <= t->mask; ++j) {
+			if (t->slots[j]) { delete(t->slots[j]); }
+		}
+		shards[i].retired.push_back(t);
+		for (size_t j = 0; j < shards[i].retired.size(); ++j) {
+			delete[] shards[i].retired.at(j)->slots;
+			delete(shards[i].retired.at(j));
+		}
+	}
+}
+
+/* an empty table
+ * arguments:
+ * 	number of slots, a power of 2
+ * 	*/
+SC_TABLE* Seq_cache::new_table(size_t n_slots) const {
+	SC_TABLE* t = new SC_TABLE;
+	t->mask = n_slots - 1;
+	t->slots = new SC_ENTRY*[n_slots]();
+	return t;
+}
+
+/* looks for a sequence in a table, safe while the shard is written to
+ * returns NULL if it is absent
+ * arguments:
+ * 	table
+ * 	sequence
+ * 	its hash
+ * 	*/
+const SC_ENTRY* Seq_cache::probe(const SC_TABLE* t, const string& seq, uint64_t h) const {
+	uint64_t s = h & t->mask;
+	const SC_ENTRY* e;
+	while ((e = __atomic_load_n(&t->slots[s], __ATOMIC_ACQUIRE)) != NULL) {
+		if ((e->hash == h) && (e->seq == seq)) { return e; }
+		s = (s + 1) & t->mask;
+	}
+	return NULL;
+}
+
+/* publishes a copy of the table of a shard with twice the slots, the
+ * shard must be locked
+ * arguments:
+ * 	shard
+ * 	*/
+void Seq_cache::grow(SC_SHARD& s) {
+	SC_TABLE* old = s.table;
+	SC_TABLE* t = new_table(2 * (old->mask + 1));
+	for (size_t i = 0; i <= old->mask; ++i) {
+		SC_ENTRY* e = old->slots[i];
+		if (!e) { continue; }
+		uint64_t j = e->hash & t->mask;
+		while (t->slots[j]) { j = (j + 1) & t->mask; }
+		t->slots[j] = e;
+	}
+	__atomic_store_n(&s.table, t, __ATOMIC_RELEASE);
+	s.retired.push_back(old);
+}
+
+/* the reference a sequence maps to, the lookup runs once per sequence
+ * returns -1 without a unique match
+ * arguments:
+ * 	sequence
+ * 	*/
+int32_t Seq_cache::find(const string& seq) {
+	uint64_t h = seq_hash(seq);
+	SC_SHARD& s = shards[h >> 58];
+
+	const SC_ENTRY* e = probe(__atomic_load_n(&s.table, __ATOMIC_ACQUIRE), seq, h);
+	if (e) {
+		__atomic_fetch_add(&s.hits, 1, __ATOMIC_RELAXED);
+		return e->ref;
+	}
+
+	// critical
+	boost::lock_guard<boost::mutex> lock(s.mtx);
+	e = probe(s.table, seq, h);
+	if (e) {
+		__atomic_fetch_add(&s.hits, 1, __ATOMIC_RELAXED);
+		return e->ref;
+	}
+
+	SC_ENTRY* n = new SC_ENTRY;
+	n->hash = h;
+	n->ref = lookup.find(seq);
+	if (n->ref < 0) { n->ref = -1; }
+	n->seq = seq;
+
+	if (2 * (s.n + 1) > s.table->mask + 1) { grow(s); }
+	uint64_t j = h & s.table->mask;
+	while (s.table->slots[j]) { j = (j + 1) & s.table->mask; }
+	__atomic_store_n(&s.table->slots[j], n, __ATOMIC_RELEASE);
+	s.n++;
+	s.misses++;
+	return n->ref;
+	// end critical
+}
+
+const Seq_lookup& Seq_cache::get_lookup() const { return lookup; }
+
+/* statistics, exact once the threads using the cache are done */
+size_t Seq_cache::size() const {
+	size_t n = 0;
+	for (size_t i = 0; i < SC_SHARDS; ++i) { n += shards[i].n; }
+	return n;
+}
+
+uint64_t Seq_cache::get_hits() const {
+	uint64_t n = 0;
+	for (size_t i = 0; i < SC_SHARDS; ++i) { n += shards[i].hits; }
+	return n;
+}
+
+uint64_t Seq_cache::get_misses() const {
+	uint64_t n = 0;
+	for (size_t i = 0; i < SC_SHARDS; ++i) { n += shards[i].misses; }
+	return n;
+}
@@ -0,0 +1,72 @@
+#ifndef __SEQ_CACHE_H__
+#define __SEQ_CACHE_H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <boost/thread.hpp>
+#include "seq_lookup.h"
+using namespace std;
+
+// number of shards, a power of 2
+static const size_t SC_SHARDS = 64;
+
+// initial slots per shard, a power of 2
+static const size_t SC_MIN_SLOTS = 256;
+
+// a looked up sequence, immutable once published
+typedef struct sc_entry {
+	uint64_t hash;
+	int32_t ref;		// reference number or -1 without a unique match
+	string seq;
+} SC_ENTRY;
+
+// open-addressing slots of a shard, replaced by a larger copy when full
+typedef struct sc_table {
+	uint64_t mask;
+	SC_ENTRY** slots;
+} SC_TABLE;
+
+// shard of the cache, the hit count written by lock free readers is padded
+// onto a cache line of its own so it does not evict the table pointer
+typedef struct sc_shard {
+	SC_TABLE* table;
+	size_t n;
+	uint64_t misses;
+	vector<SC_TABLE*> retired;
+	boost::mutex mtx;
+	char pad_hits[64];
+	uint64_t hits;
+	char pad[64];
+} SC_SHARD;
+
+/* Memo of Seq_lookup::find shared by all threads of a run, so the lookup
+ * of a sequence runs once however many threads meet it. Sequences are
+ * spread over shards by hash; each shard is a linear probing table of
+ * pointers to immutable entries. Readers take no lock: they load the table
+ * of the shard and its slots with acquire semantics and find either no
+ * entry or a complete one. A miss locks the shard, looks again, runs the
+ * lookup and publishes the entry with a release store; a table is grown by
+ * publishing a filled copy, the old one is only freed with the cache so
+ * readers still probing it stay safe. */
+class Seq_cache {
+	public:
+		Seq_cache(const Seq_lookup& l);
+		virtual ~Seq_cache();
+
+		int32_t find(const string& seq);
+
+		const Seq_lookup& get_lookup() const;
+		size_t size() const;
+		uint64_t get_hits() const;
+		uint64_t get_misses() const;
+
+	private:
+		const Seq_lookup& lookup;
+		SC_SHARD shards[SC_SHARDS];
+
+		const SC_ENTRY* probe(const SC_TABLE* t, const string& seq, uint64_t h) const;
+		SC_TABLE* new_table(size_t n_slots) const;
+		void grow(SC_SHARD& s);
+};
+#endif //__SEQ_CACHE_H__
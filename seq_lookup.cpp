@@ -0,0 +1,744 @@
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "seq_lookup.h"
+#include "utils.h"
+using namespace std;
+using namespace utils;
+
+// alphabet the neighbors are drawn from, N counts as a mismatch
+static const string SL_BASES = "ACGTN";
+
+Seq_lookup::Seq_lookup() {
+	mm = 0;
+	seq_len = 0;
+	with_table = false;
+	packed = false;
+	slot_mask = 0;
+	with_seeds = false;
+	nested = false;
+	edits = false;
+	min_len = 0;
+	max_len = 0;
+	ac_sigma = 0;
+}
+
+Seq_lookup::~Seq_lookup() {
+	for (size_t i = 0; i < groups.size(); ++i) {
+		if (groups.at(i)) { delete(groups.at(i)); }
+	}
+}
+
+/* loads reference sequences from a mapping file with the lines
+ * 	id<sep>sequence
+ * like Read_counter::load_mapping: a repeated sequence keeps the id of its
+ * last line and the sequences are added in the order of the same hash, so
+ * both programs map reads alike
+ * arguments:
+ * 	filename
+ * 	field separator
+ * 	reverse complement the sequences
+ * 	*/
+void Seq_lookup::load(char* fn, const string& sep, bool rc) {
+	string line;
+	vector<string> parts;
+	boost::unordered::unordered_map<string, string> mapping;
+
+	ifstream in;
+	attach_stream<ifstream>(fn, in, std::ifstream::in);
+
+	while (getline(in, line)) {
+		parts = split_string(line, sep);
+		if (parts.size() < 2) {
+			report_error(__FILE__, __func__, SL_CORRUPT_MAP);
+			report_error(__FILE__, __func__, line);
+			exit(SLEC_CORRUPT_MAPPING);
+		}
+
+		if (rc) { parts.at(1) = seq_revcom(parts.at(1)); }
+		mapping[parts.at(1)] = parts.at(0);
+	}
+	in.close();
+
+	boost::unordered::unordered_map<string, string>::const_iterator it;
+	for (it = mapping.begin(); it != mapping.end(); ++it) {
+		add(it->first, it->second);
+	}
+}
+
+/* adds a reference sequence, call build() afterwards
+ * arguments:
+ * 	sequence
+ * 	id
+ * 	*/
+void Seq_lookup::add(const string& seq, const string& id) {
+	seqs.push_back(seq);
+	ids.push_back(id);
+}
+
+/* registers the neighbors of reference i that differ from s at
+ * positions >= from, s is d mismatches away from the reference
+ * arguments:
+ * 	reference number
+ * 	current sequence (modified and restored)
+ * 	first position to change
+ * 	mismatches so far
+ * 	*/
+void Seq_lookup::add_neighbors(int32_t i, string& s, size_t from, uint8_t d) {
+	umsi32::iterator it = table.find(s);
+	if (it == table.end()) {
+		table[s] = i;
+		dist[s] = d;
+	} else if (d < dist[s]) {
+		it->second = i;
+		dist[s] = d;
+	} else if ((d == dist[s]) && (d > 0) && (it->second != i)) {
+		// exact duplicates keep the first reference like the linear search
+		it->second = SL_AMBIGUOUS;
+	}
+
+	if (d == mm) { return; }
+
+	for (size_t p = from; p < s.length(); ++p) {
+		char orig = s[p];
+		for (size_t b = 0; b < SL_BASES.length(); ++b) {
+			if (SL_BASES[b] == orig) { continue; }
+			s[p] = SL_BASES[b];
+			add_neighbors(i, s, p + 1, d + 1);
+		}
+		s[p] = orig;
+	}
+}
+
+/* packs a sequence of ACGTN into its base 5 code, the first base is the
+ * lowest digit
+ * returns false for other characters
+ * arguments:
+ * 	sequence
+ * 	code (output)
+ * 	*/
+bool Seq_lookup::encode(const string& s, uint64_t& code) const {
+	code = 0;
+	for (size_t p = s.length(); p-- > 0; ) {
+		uint64_t b;
+		switch (s[p]) {
+			case 'A'	: b = 0;	break;
+			case 'C'	: b = 1;	break;
+			case 'G'	: b = 2;	break;
+			case 'T'	: b = 3;	break;
+			case 'N'	: b = 4;	break;
+			default		: return false;
+		}
+		code = code * 5 + b;
+	}
+	return true;
+}
+
+/* first slot probed for a packed sequence
+ * arguments:
+ * 	code
+ * 	*/
+uint64_t Seq_lookup::slot_of(uint64_t code) const {
+	code ^= code >> 30;
+	code *= 0xbf58476d1ce4e5b9ULL;
+	code ^= code >> 27;
+	code *= 0x94d049bb133111ebULL;
+	code ^= code >> 31;
+	return code & slot_mask;
+}
+
+/* add_neighbors on packed codes, a base is changed by adding the
+ * difference of the digits at its position
+ * arguments:
+ * 	reference number
+ * 	current code
+ * 	first position to change
+ * 	mismatches so far
+ * 	*/
+void Seq_lookup::add_packed(uint32_t i, uint64_t code, size_t from, uint8_t d) {
+	uint64_t h = slot_of(code);
+	while ((slot_keys[h] != SL_EMPTY) && (slot_keys[h] != code)) { h = (h + 1) & slot_mask; }
+
+	uint32_t v = (static_cast<uint32_t>(d) << SL_DIST_SHIFT) | i;
+	if (slot_keys[h] == SL_EMPTY) {
+		slot_keys[h] = code;
+		slot_vals[h] = v;
+	} else {
+		uint8_t old_d = slot_vals[h] >> SL_DIST_SHIFT;
+		uint32_t old_i = slot_vals[h] & SL_PACKED_AMBIGUOUS;
+		if (d < old_d) {
+			slot_vals[h] = v;
+		} else if ((d == old_d) && (d > 0) && (old_i != i)) {
+			// exact duplicates keep the first reference like the linear search
+			slot_vals[h] = (static_cast<uint32_t>(d) << SL_DIST_SHIFT) | SL_PACKED_AMBIGUOUS;
+		}
+	}
+
+	if (d == mm) { return; }
+
+	for (size_t p = from; p < seq_len; ++p) {
+		uint64_t orig = (code / pow5[p]) % 5;
+		for (uint64_t b = 0; b < 5; ++b) {
+			if (b == orig) { continue; }
+			add_packed(i, code - orig * pow5[p] + b * pow5[p], p + 1, d + 1);
+		}
+	}
+}
+
+/* number of neighbors the table would hold if no two references shared
+ * any: every reference with its sequences within mm substitutions
+ * takes no arguments
+ * */
+uint64_t Seq_lookup::neighborhood_size() const {
+	uint64_t per_ref = 0;
+	uint64_t c = 1;		// choices of the changed positions
+	uint64_t v = 1;		// substitutions at those positions
+	for (uint8_t d = 0; d <= mm; ++d) {
+		per_ref += c * v;
+		c = c * (seq_len - d) / (d + 1);
+		v *= SL_BASES.length() - 1;
+	}
+	return per_ref * seqs.size();
+}
+
+/* Hamming distance of two sequences of the same length, 16 bases at a
+ * time with SSE2. Stops once it exceeds the limit
+ * arguments:
+ * 	sequence
+ * 	sequence
+ * 	length
+ * 	limit
+ * 	*/
+static uint32_t hamming(const char* a, const char* b, size_t n, uint32_t limit) {
+	uint32_t d = 0;
+	size_t i = 0;
+
+#ifdef __SSE2__
+	for (; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+		__m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+		d += __builtin_popcount(~_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) & 0xFFFF);
+		if (d > limit) { return d; }
+	}
+#endif
+	for (; i < n; ++i) { d += (a[i] != b[i]); }
+	return d;
+}
+
+/* splits the references into mm + 1 segments and indexes every segment,
+ * keyed by its number and sequence
+ * takes no arguments
+ * */
+void Seq_lookup::build_seeds() {
+	size_t n_segs = mm + 1;
+	if ((seq_len == 0) || (mm == 0) || (seq_len / n_segs < SL_MIN_SEED)) { return; }
+
+	seg_start.clear();
+	for (size_t k = 0; k <= n_segs; ++k) { seg_start.push_back(k * seq_len / n_segs); }
+
+	for (size_t i = 0; i < seqs.size(); ++i) {
+		for (size_t k = 0; k < n_segs; ++k) {
+			string key = string(1, (char) k) +
+				seqs.at(i).substr(seg_start[k], seg_start[k + 1] - seg_start[k]);
+			seeds[key].push_back(i);
+		}
+	}
+	with_seeds = true;
+}
+
+/* find() through the seed index: the references sharing a segment with
+ * the sequence are the only ones within mm mismatches, the closest of them
+ * is returned if it is unique
+ * arguments:
+ * 	sequence
+ * 	*/
+int32_t Seq_lookup::find_seeded(const string& seq) const {
+	vector<uint32_t> cands;
+	string key;
+	for (size_t k = 0; k + 1 < seg_start.size(); ++k) {
+		key.assign(1, (char) k);
+		key.append(seq, seg_start[k], seg_start[k + 1] - seg_start[k]);
+		umsvu32_cit it = seeds.find(key);
+		if (it != seeds.end()) { cands.insert(cands.end(), it->second.begin(), it->second.end()); }
+	}
+	sort(cands.begin(), cands.end());
+	cands.erase(unique(cands.begin(), cands.end()), cands.end());
+
+	uint32_t best = mm + 1;
+	uint32_t n_best = 0;
+	int32_t best_i = -1;
+	for (size_t c = 0; c < cands.size(); ++c) {
+		const string& r = seqs[cands[c]];
+		uint32_t d = hamming(seq.data(), r.data(), seq_len, best);
+		// the first identical reference like the linear search
+		if (d == 0) { return cands[c]; }
+		if (d < best) {
+			best = d;
+			n_best = 1;
+			best_i = cands[c];
+		} else if (d == best) {
+			++n_best;
+		}
+	}
+	return (n_best == 1) ? best_i : -1;
+}
+
+/* setter for counting mismatches as edit distance, call before build() */
+void Seq_lookup::set_edits(bool e) { edits = e; }
+
+/* key of segment k of the references of length l in the edit seed index
+ * arguments:
+ * 	reference length
+ * 	segment number
+ * 	*/
+static string edit_key(size_t l, size_t k) {
+	string key(3, 0);
+	key[0] = (char) (l & 0xFF);
+	key[1] = (char) (l >> 8);
+	key[2] = (char) k;
+	return key;
+}
+
+/* indexes mm + 1 segments of every reference for find_edited, references
+ * with segments shorter than SL_MIN_SEED are always compared
+ * takes no arguments
+ * */
+void Seq_lookup::build_edit_seeds() {
+	for (size_t i = 0; i < seqs.size(); ++i) {
+		if (exact.find(seqs.at(i)) == exact.end()) { exact[seqs.at(i)] = i; }
+	}
+	if (mm == 0) { return; }
+
+	size_t n_segs = mm + 1;
+	for (size_t i = 0; i < seqs.size(); ++i) {
+		size_t l = seqs.at(i).length();
+		if (l / n_segs < SL_MIN_SEED) {
+			edit_scan.push_back(i);
+			continue;
+		}
+		if (std::find(edit_lens.begin(), edit_lens.end(), l) == edit_lens.end()) { edit_lens.push_back(l); }
+		for (size_t k = 0; k < n_segs; ++k) {
+			size_t from = k * l / n_segs;
+			edit_seeds[edit_key(l, k) + seqs.at(i).substr(from, (k + 1) * l / n_segs - from)].push_back(i);
+		}
+	}
+}
+
+/* find() with mismatches counted as edit distance. Identical references
+ * come first, then containments as in find(). An alignment within mm edits
+ * leaves one of the mm + 1 segments of the reference unchanged, at most mm
+ * positions away from where it is in the reference, so only references
+ * with such a segment in the query are compared
+ * arguments:
+ * 	sequence
+ * 	*/
+int32_t Seq_lookup::find_edited(const string& seq) const {
+	umsi32_cit e = exact.find(seq);
+	if (e != exact.end()) { return e->second; }
+
+	int32_t c = -1;
+	uint8_t n = containments(seq, c);
+	if (n) { return (n == 1) ? c : -1; }
+
+	// build() keeps the references within SL_MAX_EDIT_LEN - mm bases, so a
+	// longer query is over mm edits away from all of them
+	if ((mm == 0) || seq.empty() || (seq.length() > SL_MAX_EDIT_LEN)) { return -1; }
+
+	size_t len = seq.length();
+	size_t n_segs = mm + 1;
+	vector<uint32_t> cands(edit_scan);
+	string key;
+	for (size_t g = 0; g < edit_lens.size(); ++g) {
+		size_t l = edit_lens[g];
+		if ((l > len + mm) || (len > l + mm)) { continue; }
+
+		for (size_t k = 0; k < n_segs; ++k) {
+			size_t from = k * l / n_segs;
+			size_t seg = (k + 1) * l / n_segs - from;
+			size_t lo = (from > mm) ? from - mm : 0;
+			for (size_t p = lo; (p <= from + mm) && (p + seg <= len); ++p) {
+				key = edit_key(l, k);
+				key.append(seq, p, seg);
+				umsvu32_cit it = edit_seeds.find(key);
+				if (it != edit_seeds.end()) { cands.insert(cands.end(), it->second.begin(), it->second.end()); }
+			}
+		}
+	}
+	sort(cands.begin(), cands.end());
+	cands.erase(unique(cands.begin(), cands.end()), cands.end());
+
+	MYERS_PATTERN pat;
+	myers_compile(seq, pat);
+
+	uint16_t best = mm + 1;
+	uint32_t n_best = 0;
+	int32_t best_i = -1;
+	for (size_t i = 0; i < cands.size(); ++i) {
+		const string& r = seqs[cands[i]];
+		uint16_t d = myers_distance(pat, r.data(), r.length(), best);
+		if (d < best) {
+			best = d;
+			n_best = 1;
+			best_i = cands[i];
+		} else if ((d == best) && (best_i >= 0)) {
+			++n_best;
+		}
+	}
+	return (n_best == 1) ? best_i : -1;
+}
+
+/* splits references of mixed lengths into a lookup per length
+ * takes no arguments
+ * */
+void Seq_lookup::build_groups() {
+	groups.assign(max_len + 1, NULL);
+	group_refs.assign(max_len + 1, vector<int32_t>());
+	for (size_t i = 0; i < seqs.size(); ++i) {
+		size_t l = seqs.at(i).length();
+		if (!groups.at(l)) {
+			groups.at(l) = new Seq_lookup;
+			groups.at(l)->nested = true;
+		}
+		groups.at(l)->add(seqs.at(i), ids.at(i));
+		group_refs.at(l).push_back(i);
+	}
+
+	for (size_t l = 0; l < groups.size(); ++l) {
+		if (groups.at(l)) { groups.at(l)->build(mm); }
+	}
+}
+
+/* builds the Aho-Corasick automaton of the references: a trie over the
+ * characters that occur in them, completed into a transition table with
+ * the failure links
+ * takes no arguments
+ * */
+void Seq_lookup::build_automaton() {
+	for (size_t c = 0; c < 256; ++c) { ac_code[c] = -1; }
+	ac_sigma = 0;
+	for (size_t i = 0; i < seqs.size(); ++i) {
+		for (size_t p = 0; p < seqs.at(i).length(); ++p) {
+			unsigned char c = seqs.at(i)[p];
+			if (ac_code[c] < 0) { ac_code[c] = ac_sigma++; }
+		}
+	}
+
+	// trie
+	ac_go.assign(ac_sigma, -1);
+	ac_refs.assign(1, -1);
+	ref_next.assign(seqs.size(), -1);
+	for (size_t i = 0; i < seqs.size(); ++i) {
+		int32_t node = 0;
+		for (size_t p = 0; p < seqs.at(i).length(); ++p) {
+			size_t t = node * ac_sigma + ac_code[(unsigned char) seqs.at(i)[p]];
+			if (ac_go[t] < 0) {
+				ac_go[t] = ac_refs.size();
+				ac_go.resize(ac_go.size() + ac_sigma, -1);
+				ac_refs.push_back(-1);
+			}
+			node = ac_go[t];
+		}
+		ref_next[i] = ac_refs[node];
+		ac_refs[node] = i;
+	}
+
+	// failure links breadth first, missing transitions follow them
+	size_t n_nodes = ac_refs.size();
+	ac_fail.assign(n_nodes, 0);
+	ac_out.assign(n_nodes, -1);
+	vector<int32_t> queue;
+	for (uint32_t c = 0; c < ac_sigma; ++c) {
+		if (ac_go[c] < 0) {
+			ac_go[c] = 0;
+		} else {
+			ac_out[ac_go[c]] = (ac_refs[0] >= 0) ? 0 : -1;
+			queue.push_back(ac_go[c]);
+		}
+	}
+	for (size_t q = 0; q < queue.size(); ++q) {
+		int32_t v = queue[q];
+		for (uint32_t c = 0; c < ac_sigma; ++c) {
+			int32_t u = ac_go[v * ac_sigma + c];
+			int32_t f = ac_go[ac_fail[v] * ac_sigma + c];
+			if (u < 0) {
+				ac_go[v * ac_sigma + c] = f;
+				continue;
+			}
+			ac_fail[u] = f;
+			ac_out[u] = (ac_refs[f] >= 0) ? f : ac_out[f];
+			queue.push_back(u);
+		}
+	}
+}
+
+/* orders suffixes of the references joined by SL_SEPARATOR, comparing up
+ * to the end of their reference, ties by position */
+struct Suffix_less {
+	const unsigned char* t;
+	bool operator()(uint32_t a, uint32_t b) const {
+		for (size_t k = 0; ; ++k) {
+			unsigned char x = t[a + k];
+			unsigned char y = t[b + k];
+			if (x != y) { return x < y; }
+			if (x == SL_SEPARATOR) { return a < b; }
+		}
+	}
+};
+
+/* builds the suffix array of the references
+ * takes no arguments
+ * */
+void Seq_lookup::build_suffix_array() {
+	sa_text.clear();
+	sa_ref.clear();
+	sa.clear();
+	for (size_t i = 0; i < seqs.size(); ++i) {
+		for (size_t p = 0; p < seqs.at(i).length(); ++p) { sa.push_back(sa_text.size() + p); }
+		sa_text += seqs.at(i);
+		sa_text += SL_SEPARATOR;
+		sa_ref.insert(sa_ref.end(), seqs.at(i).length() + 1, i);
+	}
+
+	Suffix_less less;
+	less.t = reinterpret_cast<const unsigned char*>(sa_text.data());
+	sort(sa.begin(), sa.end(), less);
+}
+
+/* counts a reference containing or contained in a query
+ * arguments:
+ * 	reference number
+ * 	query length
+ * 	the reference if it is the only one so far (output)
+ * 	number of references, stops at 2 (output)
+ * 	*/
+void Seq_lookup::add_containment(int32_t r, size_t len, int32_t& ref, uint8_t& n) const {
+	// same length references are only identical ones, found before
+	if (seqs[r].length() == len) { return; }
+	if (n == 0) {
+		ref = r;
+		n = 1;
+	} else if (r != ref) {
+		n = 2;
+	}
+}
+
+/* finds the references a query contains or is contained in
+ * returns their number, 0, 1 or 2 for more than one
+ * arguments:
+ * 	sequence
+ * 	the reference if there is one (output)
+ * 	*/
+uint8_t Seq_lookup::containments(const string& seq, int32_t& ref) const {
+	uint8_t n = 0;
+	size_t len = seq.length();
+
+	// references in the query, at every position the references ending there
+	if (min_len < len) {
+		int32_t state = 0;
+		for (size_t p = 0; p <= len; ++p) {
+			if (p > 0) {
+				int16_t c = ac_code[(unsigned char) seq[p - 1]];
+				state = (c < 0) ? 0 : ac_go[state * ac_sigma + c];
+				if (c < 0) { continue; }
+			}
+			int32_t u = (ac_refs[state] >= 0) ? state : ac_out[state];
+			for (; u >= 0; u = ac_out[u]) {
+				for (int32_t r = ac_refs[u]; r >= 0; r = ref_next[r]) {
+					add_containment(r, len, ref, n);
+					if (n > 1) { return n; }
+				}
+			}
+		}
+	}
+
+	// references containing the query, the suffixes it is a prefix of
+	if (max_len > len) {
+		const unsigned char* t = reinterpret_cast<const unsigned char*>(sa_text.data());
+		const unsigned char* q = reinterpret_cast<const unsigned char*>(seq.data());
+		size_t lo = 0;
+		size_t hi = sa.size();
+		while (lo < hi) {
+			size_t mid = (lo + hi) / 2;
+			const unsigned char* s = t + sa[mid];
+			size_t k = 0;
+			while ((k < len) && (s[k] == q[k])) { ++k; }
+			if ((k < len) && (s[k] < q[k])) { lo = mid + 1; } else { hi = mid; }
+		}
+		for (size_t i = lo; i < sa.size(); ++i) {
+			if (sa_text.compare(sa[i], len, seq) != 0) { break; }
+			add_containment(sa_ref[sa[i]], len, ref, n);
+			if (n > 1) { return n; }
+		}
+	}
+	return n;
+}
+
+/* builds the neighborhood table
+ * arguments:
+ * 	allowed mismatches
+ * 	*/
+void Seq_lookup::build(uint8_t m) {
+	mm = m;
+	table.clear();
+	dist.clear();
+	slot_keys.clear();
+	slot_vals.clear();
+	seeds.clear();
+	with_seeds = false;
+	for (size_t i = 0; i < groups.size(); ++i) {
+		if (groups.at(i)) { delete(groups.at(i)); }
+	}
+	groups.clear();
+	group_refs.clear();
+	exact.clear();
+	edit_lens.clear();
+	edit_seeds.clear();
+	edit_scan.clear();
+
+	seq_len = seqs.empty() ? 0 : seqs.at(0).length();
+	min_len = seq_len;
+	max_len = seq_len;
+	for (size_t i = 0; i < seqs.size(); ++i) {
+		if (seqs.at(i).length() != seq_len) { seq_len = 0; }
+		min_len = min(min_len, seqs.at(i).length());
+		max_len = max(max_len, seqs.at(i).length());
+	}
+
+	// queries within mm edits must fit the bit-parallel distance
+	if (edits && (max_len + mm > SL_MAX_EDIT_LEN)) {
+		size_t limit = (mm < SL_MAX_EDIT_LEN) ? SL_MAX_EDIT_LEN - mm : 0;
+		report_error(__FILE__, __func__, SL_EDIT_TOO_LONG);
+		report_error(__FILE__, __func__, "longest sequence " + to_string(max_len) +
+			" bases, at most " + to_string(limit) + " with " +
+			to_string(static_cast<int>(mm)) + " mismatches");
+		exit(SLEC_EDIT_TOO_LONG);
+	}
+
+	// containment of queries of other lengths
+	if (!nested && !seqs.empty()) {
+		build_automaton();
+		build_suffix_array();
+	}
+
+	if (edits) {
+		build_edit_seeds();
+		return;
+	}
+
+	if (!seq_len) {
+		build_groups();
+		return;
+	}
+
+	with_table = (seq_len > 0) && (mm <= SL_MAX_TABLE_MM) &&
+		(neighborhood_size() <= SL_MAX_TABLE_SIZE);
+	if (!with_table) {
+		build_seeds();
+		return;
+	}
+
+	packed = (seq_len <= SL_MAX_PACKED_LEN) && (seqs.size() < SL_PACKED_AMBIGUOUS);
+	vector<uint64_t> codes(seqs.size());
+	for (size_t i = 0; packed && (i < seqs.size()); ++i) {
+		packed = encode(seqs.at(i), codes.at(i));
+	}
+
+	if (packed) {
+		pow5.assign(seq_len, 1);
+		for (size_t p = 1; p < seq_len; ++p) { pow5[p] = pow5[p - 1] * 5; }
+
+		// at most 3/4 full
+		uint64_t slots = 1;
+		while (slots * 3 < neighborhood_size() * 4) { slots <<= 1; }
+		slot_mask = slots - 1;
+		slot_keys.assign(slots, SL_EMPTY);
+		slot_vals.assign(slots, 0);
+
+		for (size_t i = 0; i < seqs.size(); ++i) { add_packed(i, codes.at(i), 0, 0); }
+		return;
+	}
+
+	table.reserve(neighborhood_size());
+	for (size_t i = 0; i < seqs.size(); ++i) {
+		string s = seqs.at(i);
+		add_neighbors(i, s, 0, 0);
+	}
+
+	// distances are only needed while building
+	dist.clear();
+}
+
+/* finds the reference a sequence maps to
+ * returns the reference number or -1 if there is no unique match
+ * arguments:
+ * 	sequence
+ * 	*/
+int32_t Seq_lookup::find(const string& seq) const {
+	if (edits) { return find_edited(seq); }
+	if (nested || (seq_len && (seq.length() == seq_len))) { return find_same_length(seq); }
+	if (seqs.empty() || (mm >= seq.length())) {
+		return find_likely_match(seq, seqs, mm);
+	}
+
+	// closest reference of the same length, an identical one comes first
+	int32_t r = -1;
+	size_t len = seq.length();
+	if ((len < groups.size()) && groups.at(len)) {
+		r = groups.at(len)->find(seq);
+		if (r >= 0) { r = group_refs.at(len).at(r); }
+		if ((r >= 0) && (seqs[r] == seq)) { return r; }
+	}
+
+	// a containment is a match without mismatches
+	int32_t c = -1;
+	uint8_t n = containments(seq, c);
+	if (n) { return (n == 1) ? c : -1; }
+	return r;
+}
+
+/* find() for a query of the references' length
+ * arguments:
+ * 	sequence
+ * 	*/
+int32_t Seq_lookup::find_same_length(const string& seq) const {
+	uint64_t code;
+	if (with_table && packed && (seq.length() == seq_len) && encode(seq, code)) {
+		uint64_t h = slot_of(code);
+		while (slot_keys[h] != SL_EMPTY) {
+			if (slot_keys[h] == code) {
+				uint32_t i = slot_vals[h] & SL_PACKED_AMBIGUOUS;
+				return (i == SL_PACKED_AMBIGUOUS) ? -1 : i;
+			}
+			h = (h + 1) & slot_mask;
+		}
+		return -1;
+	}
+
+	if (with_table && !packed && (seq.length() == seq_len)) {
+		umsi32_cit it = table.find(seq);
+		if (it != table.end()) { return (it->second == SL_AMBIGUOUS) ? -1 : it->second; }
+
+		// neighbors only use ACGTN, other characters need the linear search
+		if (seq.find_first_not_of(SL_BASES) == string::npos) { return -1; }
+	}
+	if (with_seeds && (seq.length() == seq_len)) { return find_seeded(seq); }
+	return find_likely_match(seq, seqs, mm);
+}
+
+const string& Seq_lookup::get_id(int32_t i) const { return ids.at(i); }
+
+size_t Seq_lookup::size() const { return ids.size(); }
+
+size_t Seq_lookup::get_table_size() const {
+	if (!packed) { return table.size(); }
+
+	size_t n = 0;
+	for (size_t h = 0; h < slot_keys.size(); ++h) {
+		if (slot_keys[h] != SL_EMPTY) { ++n; }
+	}
+	return n;
+}
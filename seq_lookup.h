@@ -0,0 +1,166 @@
+#ifndef __SEQ_LOOKUP_H__
+#define __SEQ_LOOKUP_H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <boost/unordered_map.hpp>
+using namespace std;
+
+typedef boost::unordered::unordered_map<string, int32_t> umsi32;
+typedef boost::unordered::unordered_map<string, int32_t>::const_iterator umsi32_cit;
+typedef boost::unordered::unordered_map<string, vector<uint32_t> > umsvu32;
+typedef boost::unordered::unordered_map<string, vector<uint32_t> >::const_iterator umsvu32_cit;
+
+static string SL_CORRUPT_MAP = 	"Corrupt mapping file";
+static string SL_EDIT_TOO_LONG =	"Sequences too long for edit distance matching";
+
+enum SL_ERRORS {
+	SLEC_CORRUPT_MAPPING	=	20,
+	SLEC_EDIT_TOO_LONG	=	21
+};
+
+// largest mismatch count covered by the neighborhood table
+static const uint8_t SL_MAX_TABLE_MM = 2;
+
+// most neighbors tabled, larger neighborhoods use the linear search
+static const uint64_t SL_MAX_TABLE_SIZE = static_cast<uint64_t>(1) << 24;
+
+// marks a neighbor shared by several sequences at the same distance
+static const int32_t SL_AMBIGUOUS = -2;
+
+// longest sequence packed into a 64 bit key, a base 5 digit per base
+static const size_t SL_MAX_PACKED_LEN = 27;
+
+// packed table: empty slot, ambiguous reference and the distance bits
+static const uint64_t SL_EMPTY = ~static_cast<uint64_t>(0);
+static const uint32_t SL_PACKED_AMBIGUOUS = (1 << 30) - 1;
+static const uint32_t SL_DIST_SHIFT = 30;
+
+// shortest segment of the seed index, shorter ones use the linear search
+static const size_t SL_MIN_SEED = 4;
+
+// longest query of the bit-parallel edit distance, references are at most
+// this less the mismatches long
+static const size_t SL_MAX_EDIT_LEN = 64;
+
+// ends the references in the text of the suffix array
+static const char SL_SEPARATOR = '\0';
+
+/* Maps a sequence to one of a set of reference sequences (e.g. sample
+ * indexes) allowing mismatches, with the semantics of utils::find_likely_match.
+ * Every reference sequence is expanded into all of its neighbors within the
+ * allowed mismatches once at build time, so a lookup is a single hash probe.
+ * Neighbors reachable from two references at the same distance are marked
+ * ambiguous. References of up to SL_MAX_PACKED_LEN ACGTN bases are packed
+ * into 64 bit keys of a flat table, longer ones are tabled as strings.
+ * Where the table would be too large (more mismatches or a large library)
+ * the references are split into mm + 1 segments and each segment is
+ * indexed: by pigeonhole a reference within mm mismatches has at least one
+ * segment in common with the query, so only references sharing a segment
+ * are compared, with a 16 bases at a time Hamming distance.
+ * A query and a reference of different lengths match if one contains the
+ * other. The references contained in a query are found by running it
+ * through an Aho-Corasick automaton of the references, the references
+ * containing it by a binary search of a suffix array of the references.
+ * Several containments are ambiguous; without any, the query is matched
+ * against the references of its length, which have their own table or
+ * seed index when the references differ in length. Queries none of these
+ * can answer (bases outside ACGTN with the table, segments shorter than
+ * SL_MIN_SEED or mm not below the query length) fall back to the linear
+ * search.
+ * With set_edits() mismatches are counted as edit distance instead: after
+ * identical and containing entries, candidates sharing one of mm + 1
+ * segments with the query (shifted by up to mm by indels) are verified with
+ * a bit-parallel edit distance, the unique closest within mm is returned. */
+class Seq_lookup {
+	public:
+		Seq_lookup();
+		virtual ~Seq_lookup();
+
+		void load(char* fn, const string& sep, bool rc);
+		void add(const string& seq, const string& id);
+		void build(uint8_t mm);
+		void set_edits(bool e);
+
+		int32_t find(const string& seq) const;
+
+		const string& get_id(int32_t i) const;
+		size_t size() const;
+		size_t get_table_size() const;
+
+	private:
+		vector<string> seqs;
+		vector<string> ids;
+
+		uint8_t mm;
+		size_t seq_len;		// 0 when references differ in length
+		bool with_table;
+		bool nested;		// lookup of one length of a mixed set
+
+		// neighbor -> reference number or SL_AMBIGUOUS
+		umsi32 table;
+		boost::unordered::unordered_map<string, uint8_t> dist;
+
+		// packed neighbor -> distance << SL_DIST_SHIFT | reference number
+		bool packed;
+		vector<uint64_t> slot_keys;
+		vector<uint32_t> slot_vals;
+		uint64_t slot_mask;
+		vector<uint64_t> pow5;
+
+		// segment number + segment -> references
+		bool with_seeds;
+		vector<size_t> seg_start;
+		umsvu32 seeds;
+
+		size_t min_len;
+		size_t max_len;
+
+		// edit distance: first reference of a sequence, segment index per
+		// reference length and references too short for segments
+		bool edits;
+		umsi32 exact;
+		vector<size_t> edit_lens;
+		umsvu32 edit_seeds;
+		vector<uint32_t> edit_scan;
+
+		// references of mixed lengths: a lookup per length with the
+		// reference numbers of its entries
+		vector<Seq_lookup*> groups;
+		vector< vector<int32_t> > group_refs;
+
+		// Aho-Corasick automaton: transitions per node and alphabet code,
+		// failure links, first reference ending at a node (references
+		// ending at the same node are chained through ref_next) and the
+		// nearest node on the failure path that ends a reference
+		int16_t ac_code[256];
+		uint32_t ac_sigma;
+		vector<int32_t> ac_go;
+		vector<int32_t> ac_fail;
+		vector<int32_t> ac_refs;
+		vector<int32_t> ac_out;
+		vector<int32_t> ref_next;
+
+		// suffix array of the references joined by SL_SEPARATOR
+		string sa_text;
+		vector<uint32_t> sa;
+		vector<uint32_t> sa_ref;	// reference of every text position
+
+		void add_neighbors(int32_t i, string& s, size_t from, uint8_t d);
+		void add_packed(uint32_t i, uint64_t code, size_t from, uint8_t d);
+		bool encode(const string& s, uint64_t& code) const;
+		uint64_t slot_of(uint64_t code) const;
+		uint64_t neighborhood_size() const;
+		void build_seeds();
+		int32_t find_seeded(const string& seq) const;
+		int32_t find_same_length(const string& seq) const;
+		void build_groups();
+		void build_edit_seeds();
+		int32_t find_edited(const string& seq) const;
+		void build_automaton();
+		void build_suffix_array();
+		uint8_t containments(const string& seq, int32_t& ref) const;
+		void add_containment(int32_t r, size_t len, int32_t& ref, uint8_t& n) const;
+};
+#endif //__SEQ_LOOKUP_H__
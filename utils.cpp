@@ -8,6 +8,7 @@
 #include <algorithm>
 #include "gzstream.h"
 #include "utils.h"
+#include <sys/resource.h>
 using namespace std;
 
 /* converts a string to upper case
@@ -178,6 +179,121 @@ int utils::find_diffs(const string& a, const string& b) {
 	return res;
 }
 
+/* compiles a pattern into per-character match bitmasks for myers_scan
+ * 'x' positions match any base
+ * arguments:
+ * 	pattern string (up to 64 bases)
+ * 	pattern structure to populate
+ * 	*/
+void utils::myers_compile(const string& pat, MYERS_PATTERN& p) {
+	const string bases = "ATGCN";
+
+	for (size_t c = 0; c < 256; ++c) { p.peq[c] = 0; }
+	p.len = static_cast<uint8_t>(pat.length());
+
+	for (size_t i = 0; i < pat.length(); ++i) {
+		uint64_t bit = static_cast<uint64_t>(1) << i;
+		if (pat.at(i) == 'x') {
+			for (size_t b = 0; b < bases.length(); ++b) {
+				p.peq[static_cast<uint8_t>(bases.at(b))] |= bit;
+			}
+		} else {
+			p.peq[static_cast<uint8_t>(pat.at(i))] |= bit;
+		}
+	}
+}
+
+/* Myers' bit-vector edit distance of a pattern against a text
+ * scores.at(j) is the distance of the pattern to the best text substring
+ * ending at text[j]. With anchored set the substring has to start at text[0],
+ * otherwise it can start anywhere.
+ * arguments:
+ * 	compiled pattern
+ * 	pointer to the text
+ * 	text length
+ * 	bool anchor the alignment at the start of the text
+ * 	vector to receive the scores
+ * 	*/
+void utils::myers_scan(
+		const MYERS_PATTERN& p,
+		const char* text,
+		size_t n,
+		bool anchored,
+		vector<uint16_t>& scores) {
+
+	scores.resize(n);
+	if (p.len == 0) {
+		for (size_t j = 0; j < n; ++j) { scores[j] = anchored ? j + 1 : 0; }
+		return;
+	}
+
+	uint64_t high = static_cast<uint64_t>(1) << (p.len - 1);
+	uint64_t pv = ~static_cast<uint64_t>(0);
+	uint64_t mv = 0;
+	uint16_t score = p.len;
+
+	for (size_t j = 0; j < n; ++j) {
+		uint64_t eq = p.peq[static_cast<uint8_t>(text[j])];
+		uint64_t xv = eq | mv;
+		uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+		uint64_t ph = mv | ~(xh | pv);
+		uint64_t mh = pv & xh;
+
+		if (ph & high) { score++; }
+		else if (mh & high) { score--; }
+
+		// the top row grows by one per column for anchored alignments
+		ph = (ph << 1) | (anchored ? 1 : 0);
+		mh <<= 1;
+		pv = mh | ~(xv | ph);
+		mv = ph & xv;
+
+		scores[j] = score;
+	}
+}
+
+/* Myers' bit-vector edit distance of a pattern to a whole text (both
+ * ends anchored). The distance can drop by at most one per remaining text
+ * character, so the scan stops once it cannot end within the limit.
+ * Not banded: the pattern fits one 64 bit word, so a column costs the same
+ * few word operations as a band of 2 * limit + 1 cells would, and the early
+ * stop already bounds the work by the limit
+ * arguments:
+ * 	compiled pattern
+ * 	pointer to the text
+ * 	text length
+ * 	largest distance of interest
+ * 	*/
+uint16_t utils::myers_distance(const MYERS_PATTERN& p, const char* text, size_t n, uint16_t limit) {
+	size_t diff = (n > p.len) ? n - p.len : p.len - n;
+	if (diff > limit) { return limit + 1; }
+	if (p.len == 0) { return n; }
+
+	uint64_t high = static_cast<uint64_t>(1) << (p.len - 1);
+	uint64_t pv = ~static_cast<uint64_t>(0);
+	uint64_t mv = 0;
+	size_t score = p.len;
+
+	for (size_t j = 0; j < n; ++j) {
+		uint64_t eq = p.peq[static_cast<uint8_t>(text[j])];
+		uint64_t xv = eq | mv;
+		uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+		uint64_t ph = mv | ~(xh | pv);
+		uint64_t mh = pv & xh;
+
+		if (ph & high) { score++; }
+		else if (mh & high) { score--; }
+
+		ph = (ph << 1) | 1;
+		mh <<= 1;
+		pv = mh | ~(xv | ph);
+		mv = ph & xv;
+
+		if (score > limit + (n - j - 1)) { return limit + 1; }
+	}
+	return score;
+}
+
 /* splits a string into a vector using a delimiter
  * arguments:
  * 	string to be split
@@ -252,7 +368,7 @@ int utils::seq_qual(const string& seq, int q) {
  * 	vector of strings as library
  *	int number of allowed mismatches
  *	*/
-int utils::find_likely_match(const string& seq, vector<string>& lookup, int mm) {
+int utils::find_likely_match(const string& seq, const vector<string>& lookup, int mm) {
 	vector<int> mms;
 
 	for (size_t i = 0; i < lookup.size(); ++i) {
@@ -310,6 +426,58 @@ int utils::find_likely_match(const string& seq, vector<string>& lookup, int mm)
 	return min_ind;
 }
 
+/* memory the process may use: MemAvailable of /proc/meminfo, lowered to
+ * what is left under a cgroup (v2 or v1) limit. 0 if unknown or if the
+ * cgroup limit is used up
+ * arguments:
+ * 	set to true if the cgroup limit is used up (output, optional)
+ * 	*/
+uint64_t utils::available_memory(bool* exhausted) {
+	uint64_t avail = 0;
+	if (exhausted) { *exhausted = false; }
+	string name, rest;
+	uint64_t kb;
+
+	ifstream mi("/proc/meminfo");
+	while (mi >> name >> kb) {
+		getline(mi, rest);
+		if (name == "MemAvailable:") {
+			avail = kb * 1024;
+			break;
+		}
+	}
+	mi.close();
+
+	const char* limits[] = {"/sys/fs/cgroup/memory.max", "/sys/fs/cgroup/memory/memory.limit_in_bytes"};
+	const char* usage[] = {"/sys/fs/cgroup/memory.current", "/sys/fs/cgroup/memory/memory.usage_in_bytes"};
+	for (uint8_t i = 0; i < 2; ++i) {
+		ifstream l(limits[i]);
+		string s;
+		if (!(l >> s)) { continue; }
+		if (s == "max") { break; }
+
+		uint64_t limit = strtoull(s.c_str(), NULL, 10);
+		uint64_t used = 0;
+		ifstream u(usage[i]);
+		u >> used;
+		uint64_t left = (limit > used) ? limit - used : 0;
+		if ((avail == 0) || (left < avail)) { avail = left; }
+		if (exhausted && !left) { *exhausted = true; }
+		break;
+	}
+	return avail;
+}
+
+/* largest resident set of the process so far in bytes, of all its threads
+ * and whatever they ran (e.g. several lanes)
+ * takes no arguments
+ * */
+uint64_t utils::peak_rss() {
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return (uint64_t) ru.ru_maxrss * 1024;
+}
+
 /* general purpose error reporting function
  * arguments
  * 	string
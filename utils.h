@@ -25,6 +25,26 @@ namespace utils {
 	// find differences between two strings
 	int find_diffs(const string& a, const string& b);
 
+	// bit-parallel pattern used by the edit distance functions (up to 64 bases)
+	typedef struct myers_pattern {
+		uint64_t	peq[256];
+		uint8_t		len;
+	} MYERS_PATTERN;
+
+	// compiles a pattern for use with myers_scan
+	void myers_compile(const string& pat, MYERS_PATTERN& p);
+
+	// edit distance of a pattern against a text, reported at every end position
+	void myers_scan(
+			const MYERS_PATTERN& p,
+			const char* text,
+			size_t n,
+			bool anchored,
+			vector<uint16_t>& scores);
+
+	// edit distance of a pattern to a whole text, limit + 1 once above limit
+	uint16_t myers_distance(const MYERS_PATTERN& p, const char* text, size_t n, uint16_t limit);
+
 	// splits a string at a specific separator
 	vector<string> split_string(const string& str, const string& sep);
 
@@ -35,7 +55,7 @@ namespace utils {
 	string seq_revcom(const string& seq);
 
 	// finds a likely match of a string given a library of possible matches
-	int find_likely_match(const string& seq, vector<string>& choices, int mm);
+	int find_likely_match(const string& seq, const vector<string>& choices, int mm);
 
 	// counts number of bases in a sequence with quality lower than specified quality
 	int seq_qual(const string& seq, int q);
@@ -62,6 +82,13 @@ namespace utils {
 		}
 	}
 
+	// memory the process may use (MemAvailable under any cgroup limit), 0 if
+	// unknown or the cgroup limit is used up
+	uint64_t available_memory(bool* exhausted = NULL);
+
+	// peak resident memory of the whole process in bytes
+	uint64_t peak_rss();
+
 	// general purpose error reporting function
 	void report_error(const string& file, const string& func, const string& error_msg);
 